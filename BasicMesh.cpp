@@ -23,6 +23,8 @@
 
 #include "BasicMesh.h"
 #include "SingleTimeCommand.h"
+#include "UploadManager.h"
+#include "Trace.h"
 
 #define	EPS	0.00001f
 
@@ -39,24 +41,33 @@ BasicMesh :: BasicMesh ( Device& dev, BasicVertex * verticesPtr, const int * ind
 	if ( verticesPtr [0].n.length () < 0.001 )
 		computeNormals  ( verticesPtr, indicesPtr, nv, nt );
 		
-	createBuffer ( vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,     numVertices  * sizeof ( verticesPtr [0] ),      verticesPtr );
-	createBuffer ( indices,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT,  3 * numTriangles * sizeof ( indicesPtr  [0] ), indicesPtr  );
+				// take range of shared buffers if there is a heap, own buffers if it is full
+	GeometryHeap * geometryHeap = dev.getGeometryHeap ();
+
+	if ( geometryHeap != nullptr && geometryHeap->getVertexStride () == sizeof ( BasicVertex ) && geometryHeap->alloc ( verticesPtr, numVertices, indicesPtr, 3 * numTriangles, range ) )
+		heap = geometryHeap;
+	else
+	{
+		createBuffer ( vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,     numVertices  * sizeof ( verticesPtr [0] ),      verticesPtr );
+		createBuffer ( indices,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT,  3 * numTriangles * sizeof ( indicesPtr  [0] ), indicesPtr  );
+	}
 
 	for ( int i = 0; i < nv; i++ )
 		box.addVertex ( verticesPtr [i].pos );
 }
 
+BasicMesh :: ~BasicMesh ()
+{
+	if ( heap != nullptr )
+		heap->free ( range );
+}
+
 			// create buffer and fill using staging buffer
 void	BasicMesh::createBuffer ( Buffer& buffer, uint32_t usage, size_t size, const void * data )
 {
-	Buffer	stagingBuffer;
-	SingleTimeCommand	cmd ( *device );
-
-				// use staging buffer to copy data to GPU-local memory
-	stagingBuffer.create ( *device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-	stagingBuffer.copy   ( data, size );
-	buffer.create        ( *device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-	buffer.copyBuffer    ( cmd, stagingBuffer, size );
+				// copy goes through staging ring of upload manager, no wait here
+	buffer.create ( *device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+	device->getUploader ()->uploadBuffer ( buffer, data, size );
 }
 	
 void	computeNormals  ( BasicVertex * vertices, const int * indices, size_t nv, size_t nt )
@@ -619,6 +630,7 @@ static BasicMesh * loadMeshFromMesh ( Device& dev, const aiMesh * mesh, const gl
 
 BasicMesh * loadMesh ( Device& dev, const char * fileName, float scale )
 {
+	TraceScope		 trace ( "loadMesh", fileName );
 	Assimp::Importer importer;
 	const int        flags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
 	const aiScene  * scene = importer.ReadFile ( fileName, flags );
@@ -631,6 +643,7 @@ BasicMesh * loadMesh ( Device& dev, const char * fileName, float scale )
 
 BasicMesh * loadMesh ( Device& dev, const char * fileName, const glm::mat3& scale, const glm::vec3& offs )
 {
+	TraceScope		 trace ( "loadMesh", fileName );
 	Assimp::Importer importer;
 	const int        flags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
 	const aiScene  * scene = importer.ReadFile ( fileName, flags );
@@ -645,6 +658,7 @@ BasicMesh * loadMesh ( Device& dev, const char * fileName, const glm::mat3& scal
 
 bool loadAllMeshes ( const char * fileName, MultiMesh& mesh, float scale )
 {
+	TraceScope		 trace ( "loadAllMeshes", fileName );
 	Assimp::Importer importer;
 	const int        flags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
 	const aiScene  * scene = importer.ReadFile ( fileName, flags );
@@ -779,13 +793,8 @@ void	MultiMesh::create ( Device& dev )
 
 void	MultiMesh::createBuffer ( Buffer& buffer, uint32_t usage, size_t size, const void * data )
 {
-	Buffer				stagingBuffer;
-	SingleTimeCommand	cmd ( *device );
-
-				// use staging buffer to copy data to GPU-local memory
-	stagingBuffer.create ( *device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-	stagingBuffer.copy   ( data, size );
-	buffer.create        ( *device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-	buffer.copyBuffer    ( cmd, stagingBuffer, size );
+				// copy goes through staging ring of upload manager, no wait here
+	buffer.create ( *device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+	device->getUploader ()->uploadBuffer ( buffer, data, size );
 }
 	
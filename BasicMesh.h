@@ -26,6 +26,7 @@
 #include "Texture.h"
 #include "Pipeline.h"
 #include "Device.h"
+#include "GeometryHeap.h"
 #include "bbox.h"
 
 struct  BasicVertex
@@ -44,6 +45,8 @@ class BasicMesh
 	Device		  * device = nullptr;
 	Buffer			vertices;		// vertex data
 	Buffer			indices;		// index buffer
+	GeometryHeap  * heap = nullptr;	// when set, geometry lives in range of shared buffers
+	GeometryRange	range;
 	int	         	numVertices;
 	int	         	numTriangles;
 	std::string  	name;
@@ -52,15 +55,67 @@ class BasicMesh
 	
 public:
 	BasicMesh ( Device& dev, BasicVertex * vertices, const int * indices, size_t nv, size_t nt );
+	~BasicMesh ();
 	
 	void	render ( VkCommandBuffer commandBuffer )
 	{
-		VkBuffer		vertexBuffers [] = { vertices.getHandle () };
-		VkDeviceSize	offsets       [] = { 0 };
+		if ( heap != nullptr )
+			heap->bind ( commandBuffer );
+		else
+		{
+			VkBuffer		vertexBuffers [] = { vertices.getHandle () };
+			VkDeviceSize	offsets       [] = { 0 };
 
-		vkCmdBindVertexBuffers ( commandBuffer, 0, 1, vertexBuffers, offsets );
-		vkCmdBindIndexBuffer   ( commandBuffer, indices.getHandle (), 0, VK_INDEX_TYPE_UINT32 );
-		vkCmdDrawIndexed       ( commandBuffer, numTriangles*3, 1, 0, 0, 0 );
+			vkCmdBindVertexBuffers ( commandBuffer, 0, 1, vertexBuffers, offsets );
+			vkCmdBindIndexBuffer   ( commandBuffer, indices.getHandle (), 0, VK_INDEX_TYPE_UINT32 );
+		}
+
+		draw ( commandBuffer );
+	}
+
+			// draw only, buffers must be already bound (by GeometryHeap::bind for meshes in heap)
+	void	draw ( VkCommandBuffer commandBuffer )
+	{
+		vkCmdDrawIndexed ( commandBuffer, numTriangles*3, 1, range.firstIndex, (int32_t) range.firstVertex, 0 );
+	}
+
+	bool	isInHeap () const
+	{
+		return heap != nullptr;
+	}
+
+	const GeometryRange&	getRange () const
+	{
+		return range;
+	}
+
+	uint32_t	getFirstIndex () const
+	{
+		return range.firstIndex;
+	}
+
+	int32_t	getVertexOffset () const
+	{
+		return (int32_t) range.firstVertex;
+	}
+
+	uint32_t	getIndexCount () const
+	{
+		return numTriangles * 3;
+	}
+
+			// parameters for vkCmdDrawIndexedIndirect
+	VkDrawIndexedIndirectCommand	getDrawCommand ( uint32_t instanceCount = 1, uint32_t firstInstance = 0 ) const
+	{
+		VkDrawIndexedIndirectCommand	cmd = {};
+
+		cmd.indexCount    = getIndexCount ();
+		cmd.instanceCount = instanceCount;
+		cmd.firstIndex    = range.firstIndex;
+		cmd.vertexOffset  = (int32_t) range.firstVertex;
+		cmd.firstInstance = firstInstance;
+
+		return cmd;
 	}
 	//void	renderInstanced ( int primCount );
 	
@@ -219,6 +274,22 @@ struct MultiMesh
 		vkCmdDrawIndexed       ( commandBuffer, numIndices, 1, indexStart, 0, 0 );
 	}
 
+			// draw meshes [first, last) with buffers bound once, mesh index is passed as
+			// first instance, so shader gets it in gl_InstanceIndex and fetches its material
+	void	renderRange ( VkCommandBuffer commandBuffer, uint32_t first, uint32_t last )
+	{
+		assert ( first <= last && last <= numMeshes );
+
+		VkBuffer		vertexBuffers [] = { vertexBuf.getHandle () };
+		VkDeviceSize	offsets       [] = { 0 };
+
+		vkCmdBindVertexBuffers ( commandBuffer, 0, 1, vertexBuffers, offsets );
+		vkCmdBindIndexBuffer   ( commandBuffer, indexBuf.getHandle (), 0, VK_INDEX_TYPE_UINT32 );
+
+		for ( uint32_t i = first; i < last; i++ )
+			vkCmdDrawIndexed ( commandBuffer, counts [i], 1, indicesList [i], 0, i );
+	}
+
 protected:
 	void	createBuffer ( Buffer& buffer, uint32_t usage, size_t size, const void * data );	
 };
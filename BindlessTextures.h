@@ -0,0 +1,173 @@
+//
+// One descriptor set holding all textures of a scene in a single array.
+// Set layout comes from pipeline (DescSetLayout::addBindless for the array binding),
+// textures are added one by one and addressed in shaders by index, so materials
+// become indices in a buffer and a whole mesh is drawn with one set bound.
+// Requires Device::hasDescriptorIndexing
+//
+
+#pragma once
+
+#include	<map>
+#include	<utility>
+#include	<vector>
+#include	"Log.h"
+#include	"Device.h"
+#include	"Buffer.h"
+#include	"Texture.h"
+
+class	BindlessTextures
+{
+	Device						  * device         = nullptr;
+	VkDescriptorPool				pool           = VK_NULL_HANDLE;
+	VkDescriptorSet					set            = VK_NULL_HANDLE;
+	uint32_t						textureBinding = 0;
+	uint32_t						capacity       = 0;
+	std::map<std::pair<VkImageView, VkSampler>, uint32_t>	indices;	// same texture and sampler share index
+
+public:
+	enum
+	{
+		maxBuffers = 4						// other (buffer) bindings of the set
+	};
+
+	BindlessTextures () = default;
+	~BindlessTextures ()
+	{
+		clean ();
+	}
+
+	BindlessTextures ( const BindlessTextures& ) = delete;
+	BindlessTextures& operator = ( const BindlessTextures& ) = delete;
+
+	VkDescriptorSet	getHandle () const
+	{
+		return set;
+	}
+
+	uint32_t	getCount () const
+	{
+		return (uint32_t) indices.size ();
+	}
+
+	uint32_t	getCapacity () const
+	{
+		return capacity;
+	}
+
+			// set and all its indices are gone, GPU must not use them
+	void	clean ()
+	{
+		if ( pool != VK_NULL_HANDLE )
+			vkDestroyDescriptorPool ( device->getDevice (), pool, nullptr );
+
+		pool = VK_NULL_HANDLE;
+		set  = VK_NULL_HANDLE;
+
+		indices.clear ();
+	}
+
+			// maxTextures must not exceed count given to addBindless for textureBinding
+	void	create ( Device& dev, VkDescriptorSetLayout layout, uint32_t binding, uint32_t maxTextures )
+	{
+#ifdef	VK_EXT_descriptor_indexing
+		if ( !dev.hasDescriptorIndexing () )
+			fatal () << "BindlessTextures: descriptor indexing is not enabled on device" << Log::endl;
+
+		device         = &dev;
+		textureBinding = binding;
+		capacity       = maxTextures;
+
+		VkDescriptorPoolSize		sizes [] =
+		{
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxTextures },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         maxBuffers  },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         maxBuffers  }
+		};
+		VkDescriptorPoolCreateInfo	poolInfo = {};
+
+		poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+		poolInfo.poolSizeCount = sizeof ( sizes ) / sizeof ( sizes [0] );
+		poolInfo.pPoolSizes    = sizes;
+		poolInfo.maxSets       = 1;
+
+		if ( vkCreateDescriptorPool ( device->getDevice (), &poolInfo, nullptr, &pool ) != VK_SUCCESS )
+			fatal () << "BindlessTextures: failed to create descriptor pool!" << Log::endl;
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfoEXT	countInfo = {};
+		VkDescriptorSetAllocateInfo								allocInfo = {};
+
+		countInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+		countInfo.descriptorSetCount = 1;
+		countInfo.pDescriptorCounts  = &capacity;
+		allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext              = &countInfo;
+		allocInfo.descriptorPool     = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts        = &layout;
+
+		if ( vkAllocateDescriptorSets ( device->getDevice (), &allocInfo, &set ) != VK_SUCCESS )
+			fatal () << "BindlessTextures: failed to allocate descriptor set!" << Log::endl;
+#else
+		fatal () << "BindlessTextures: built without VK_EXT_descriptor_indexing" << Log::endl;
+#endif
+	}
+
+			// index of texture in the array, written on first use
+	uint32_t	add ( Texture& texture, Sampler& sampler )
+	{
+		auto	key = std::make_pair ( texture.getImageView (), sampler.getHandle () );
+		auto	it  = indices.find ( key );
+
+		if ( it != indices.end () )
+			return it->second;
+
+		if ( indices.size () >= capacity )
+			fatal () << "BindlessTextures: more than " << capacity << " textures" << Log::endl;
+
+		uint32_t				index     = (uint32_t) indices.size ();
+		VkDescriptorImageInfo	imageInfo = {};
+		VkWriteDescriptorSet	write     = {};
+
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView   = key.first;
+		imageInfo.sampler     = key.second;
+
+		write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet          = set;
+		write.dstBinding      = textureBinding;
+		write.dstArrayElement = index;
+		write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo      = &imageInfo;
+
+		vkUpdateDescriptorSets ( device->getDevice (), 1, &write, 0, nullptr );
+
+		indices [key] = index;
+
+		return index;
+	}
+
+			// other bindings of the set, e.g. storage buffer with materials
+	BindlessTextures&	addBuffer ( uint32_t binding, VkDescriptorType type, Buffer& buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE )
+	{
+		VkDescriptorBufferInfo	bufferInfo = {};
+		VkWriteDescriptorSet	write      = {};
+
+		bufferInfo.buffer = buffer.getHandle ();
+		bufferInfo.offset = offset;
+		bufferInfo.range  = size;
+
+		write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet          = set;
+		write.dstBinding      = binding;
+		write.descriptorType  = type;
+		write.descriptorCount = 1;
+		write.pBufferInfo     = &bufferInfo;
+
+		vkUpdateDescriptorSets ( device->getDevice (), 1, &write, 0, nullptr );
+
+		return *this;
+	}
+};
@@ -3,14 +3,20 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include	<vector>
+#include	<algorithm>
+
 #include	"Log.h"
 #include	"SingleTimeCommand.h"
 #include	"Device.h"
+#include	"MemoryAllocator.h"
+#include	"DeletionQueue.h"
+#include	"DescriptorSetCache.h"
 
 class GpuMemory
 {
 	Device		  * device = nullptr;
-	VkDeviceMemory	memory = VK_NULL_HANDLE;
+	MemoryAllocation	allocation;
 	VkDeviceSize	size   = 0;
 
 public:
@@ -35,9 +41,20 @@ public:
 		return device->getPhysicalDevice ();
 	}
 
+	Device * getOwner () const
+	{
+		return device;
+	}
+
 	VkDeviceMemory	getMemory () const
 	{
-		return memory;
+		return allocation.memory;
+	}
+
+			// offset of our range inside getMemory (), resources must be bound at it
+	VkDeviceSize	getOffset () const
+	{
+		return allocation.offset;
 	}
 
 	VkDeviceSize	getSize () const
@@ -45,25 +62,57 @@ public:
 		return size;
 	}
 
+	DeletionQueue * getDeletionQueue () const
+	{
+		return device != nullptr ? device->getDeletionQueue () : nullptr;
+	}
+
 	void	clean ()
 	{
-		if ( memory != VK_NULL_HANDLE )
-			vkFreeMemory ( device->getDevice (), memory, nullptr );
+		release ( device, allocation );
 
-		memory = VK_NULL_HANDLE;
+		allocation = MemoryAllocation ();
 	}
 
-	bool	alloc ( Device& dev, VkMemoryRequirements memRequirements, VkMemoryPropertyFlags properties )
+			// free memory after frames that may still use it are retired
+	void	deferredClean ()
 	{
+		DeletionQueue * queue = getDeletionQueue ();
+
+		if ( queue == nullptr || allocation.memory == VK_NULL_HANDLE )
+		{
+			clean ();
+			return;
+		}
+
+		Device		  * dev = device;
+		MemoryAllocation	alloc = allocation;
+
+		queue->push ( [dev, alloc] () mutable { release ( dev, alloc ); } );
+
+		allocation = MemoryAllocation ();
+	}
+
+			// linear is false for optimal-tiled images, so they never share a page with buffers
+	bool	alloc ( Device& dev, VkMemoryRequirements memRequirements, VkMemoryPropertyFlags properties, bool linear = true )
+	{
+		device = &dev;
+		size   = memRequirements.size;
+
+		uint32_t	memoryType = findMemoryType ( memRequirements.memoryTypeBits, properties );
+
+		if ( device->getAllocator () != nullptr )
+			return device->getAllocator ()->alloc ( memRequirements, memoryType, linear, allocation );
+
 		VkMemoryAllocateInfo allocInfo = {};
 		
-		device                    = &dev;
-		size                      = memRequirements.size;
 		allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 		allocInfo.allocationSize  = size;
-		allocInfo.memoryTypeIndex = findMemoryType ( memRequirements.memoryTypeBits, properties );
+		allocInfo.memoryTypeIndex = memoryType;
+		allocation.size           = size;
+		allocation.memoryType     = memoryType;
 
-		return vkAllocateMemory ( device->getDevice (), &allocInfo, nullptr, &memory ) == VK_SUCCESS;
+		return vkAllocateMemory ( device->getDevice (), &allocInfo, nullptr, &allocation.memory ) == VK_SUCCESS;
 	}
 
 	uint32_t findMemoryType ( uint32_t typeFilter, VkMemoryPropertyFlags properties ) const
@@ -85,31 +134,89 @@ public:
 	{
 		assert ( offs + size <= this->size );
 
-		void * data;
-
-		if ( !memory )
+		if ( !allocation.memory )
 			return false;
 
-		vkMapMemory   ( device->getDevice (), memory, 0, size, 0, &data );
-		memcpy        ( offs + (char *) data,  ptr, size );
-		vkUnmapMemory ( device->getDevice (), memory );
+		memcpy ( map ( size, offs ), ptr, size );
+		flush  ( offs, size );
+		unmap  ();
 
-		// vkInvalidateMappedMemoryRanges if not host coherent
 		return true;
 	}
+
+	bool	isHostCoherent () const
+	{
+		if ( device->getAllocator () != nullptr )
+			return device->getAllocator ()->isHostCoherent ( allocation.memoryType );
+
+		VkPhysicalDeviceMemoryProperties 	memProperties;
+		
+		vkGetPhysicalDeviceMemoryProperties ( device->getPhysicalDevice (), &memProperties );
+
+		return (memProperties.memoryTypes [allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	}
+
+			// make host writes visible to device, no-op for host-coherent memory
+	void	flush ( VkDeviceSize offs = 0, VkDeviceSize len = VK_WHOLE_SIZE )
+	{
+		if ( isHostCoherent () )
+			return;
+
+		VkDeviceSize		atom  = device->getLimits ().nonCoherentAtomSize;
+		VkMappedMemoryRange	range = {};
+
+		if ( len == VK_WHOLE_SIZE )
+			len = size - offs;
+
+		VkDeviceSize	start = allocation.offset + offs;
+		VkDeviceSize	end   = start + len;
+
+		range.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation.memory;
+		range.offset = (start / atom) * atom;
+		range.size   = ((end + atom - 1) / atom) * atom - range.offset;
+
+				// dedicated allocations have exact size, rounded range may run past its end
+		if ( allocation.block == nullptr && range.offset + range.size > size )
+			range.size = VK_WHOLE_SIZE;
+
+		vkFlushMappedMemoryRanges ( device->getDevice (), 1, &range );
+	}
 	
+			// sub-allocated host-visible memory is persistently mapped, so map/unmap are cheap
 	void * map ( VkDeviceSize size, size_t offs = 0 )
 	{
-		void * data;
-		
-		vkMapMemory ( device->getDevice (), memory, 0, size, 0, &data );
+		if ( allocation.mapped == nullptr )
+			vkMapMemory ( device->getDevice (), allocation.memory, allocation.offset, VK_WHOLE_SIZE, 0, (void **) &allocation.mapped );
 		
-		return data;
+		return allocation.mapped + offs;
 	}
 	
 	void	unmap () 
 	{
-		vkUnmapMemory ( device->getDevice (), memory );
+		if ( allocation.block == nullptr && device->getAllocator () == nullptr )
+		{
+			vkUnmapMemory ( device->getDevice (), allocation.memory );
+
+			allocation.mapped = nullptr;
+		}
+	}
+
+private:
+	static void	release ( Device * dev, MemoryAllocation& alloc )
+	{
+		if ( alloc.memory == VK_NULL_HANDLE )
+			return;
+
+		if ( dev->getAllocator () != nullptr )
+			dev->getAllocator ()->free ( alloc );
+		else
+		{
+			if ( alloc.mapped != nullptr )
+				vkUnmapMemory ( dev->getDevice (), alloc.memory );
+
+			vkFreeMemory ( dev->getDevice (), alloc.memory, nullptr );
+		}
 	}
 };
 
@@ -147,6 +254,8 @@ public:
 	
 	void	clean ()
 	{
+		DescriptorSetCache::forget ( memory.getOwner (), buffer );
+
 		if ( buffer != VK_NULL_HANDLE )
 		        vkDestroyBuffer ( memory.getDevice (), buffer, nullptr );
 
@@ -155,16 +264,53 @@ public:
 		memory.clean ();
 	}
 
-	bool	create ( Device& dev, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties )
+			// destroy after frames that may still use buffer are retired
+	void	deferredClean ()
+	{
+		DeletionQueue * queue = memory.getDeletionQueue ();
+
+		DescriptorSetCache::forget ( memory.getOwner (), buffer );
+
+		if ( queue != nullptr && buffer != VK_NULL_HANDLE )
+		{
+			VkDevice	dev = memory.getDevice ();
+			VkBuffer	buf = buffer;
+
+			queue->push ( [dev, buf] () { vkDestroyBuffer ( dev, buf, nullptr ); } );
+		}
+		else
+		if ( buffer != VK_NULL_HANDLE )
+			vkDestroyBuffer ( memory.getDevice (), buffer, nullptr );
+
+		buffer = VK_NULL_HANDLE;
+
+		memory.deferredClean ();
+	}
+
+			// when sharedFamilies has more than one family buffer is created with concurrent sharing,
+			// so queues of these families can use it without ownership transfers
+	bool	create ( Device& dev, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const std::vector<uint32_t>& sharedFamilies = {} )
 	{
 		VkBufferCreateInfo		bufferInfo = {};
 		VkMemoryRequirements	memRequirements;
+		std::vector<uint32_t>	families;
+
+		for ( auto f : sharedFamilies )
+			if ( std::find ( families.begin (), families.end (), f ) == families.end () )
+				families.push_back ( f );
 
 		bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size        = size;
 		bufferInfo.usage       = usage;
 		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+		if ( families.size () > 1 )
+		{
+			bufferInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+			bufferInfo.queueFamilyIndexCount = (uint32_t) families.size ();
+			bufferInfo.pQueueFamilyIndices   = families.data ();
+		}
+
 		if ( vkCreateBuffer ( dev.getDevice (), &bufferInfo, nullptr, &buffer ) != VK_SUCCESS )
 			fatal () << "Buffer: failed to create buffer!";
 
@@ -173,7 +319,7 @@ public:
 		if ( !memory.alloc ( dev, memRequirements, properties ) )
 			fatal () << "Buffer: cannot allocate memorry";
 
-		vkBindBufferMemory ( dev.getDevice (), buffer, memory.getMemory (), 0 );
+		vkBindBufferMemory ( dev.getDevice (), buffer, memory.getMemory (), memory.getOffset () );
 
 		return true;
 	}
@@ -19,6 +19,7 @@ class	CameraController : public Controller
 	float		sideStep  = 0.2f;
 	double		lastX = -1;
 	double		lastY = -1;
+	float		pathRadius = 0;		// of benchmark orbit
 	bool		forwardPressed  = false;
 	bool		leftPressed     = false;
 	bool		rightPressed    = false;
@@ -151,6 +152,20 @@ public:
 		}
 	}
 	
+		// orbit around origin at distance of initial position, looking at it
+	virtual	void	followPath ( double t ) override
+	{
+		if ( pathRadius == 0 )
+			pathRadius = glm::length ( camera.getPos () );
+
+		yaw   = (float)(0.5 * t);
+		pitch = 0.3f;
+		roll  = 0;
+
+		camera.setEulerAngles ( yaw, pitch, roll );
+		camera.moveTo         ( -pathRadius * camera.getViewDir () );
+	}
+
 	virtual	void	timeElapsed ( double delta ) override
 	{
 		float	dt = (float) delta;
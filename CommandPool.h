@@ -20,7 +20,8 @@ public:
 
 	void	clean ()
 	{
-		vkDestroyCommandPool ( device->getDevice (), pool, nullptr );
+		if ( pool != VK_NULL_HANDLE )
+			vkDestroyCommandPool ( device->getDevice (), pool, nullptr );
 		
 		pool = VK_NULL_HANDLE;
 	}
@@ -43,7 +44,7 @@ public:
 			fatal () << "CommandPool: failed to create command pool!" << Log::endl;
 	}
 
-	void	alloc ( std::vector<VkCommandBuffer>& commandBuffers, uint32_t n )
+	void	alloc ( std::vector<VkCommandBuffer>& commandBuffers, uint32_t n, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY )
 	{
 		commandBuffers.resize ( n );
 
@@ -51,21 +52,21 @@ public:
 
 		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.commandPool        = pool;
-		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.level              = level;
 		allocInfo.commandBufferCount = n;
 
 		if ( vkAllocateCommandBuffers ( device->getDevice (), &allocInfo, commandBuffers.data () ) != VK_SUCCESS )
 			fatal () << "CommandPool: failed to allocate command buffers!";
 	}
 
-	VkCommandBuffer	alloc ()
+	VkCommandBuffer	alloc ( VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY )
 	{
 		VkCommandBufferAllocateInfo	allocInfo = {};
 		VkCommandBuffer			cmd       = VK_NULL_HANDLE;
 
 		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.commandPool        = pool;
-		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.level              = level;
 		allocInfo.commandBufferCount = 1;
 
 		if ( vkAllocateCommandBuffers ( device->getDevice (), &allocInfo, &cmd ) != VK_SUCCESS )
@@ -73,4 +74,74 @@ public:
 
 		return cmd;
 	}
+
+	void	free ( std::vector<VkCommandBuffer>& commandBuffers )
+	{
+		if ( !commandBuffers.empty () )
+			vkFreeCommandBuffers ( device->getDevice (), pool, (uint32_t) commandBuffers.size (), commandBuffers.data () );
+
+		commandBuffers.clear ();
+	}
+
+			// return all command buffers of the pool to initial state, none may be pending
+	void	reset ()
+	{
+		if ( vkResetCommandPool ( device->getDevice (), pool, 0 ) != VK_SUCCESS )
+			fatal () << "CommandPool: failed to reset command pool!" << Log::endl;
+	}
+};
+
+		// pool for command buffers recorded every frame, reset as a whole once the frame
+		// using it is complete, buffers are kept and handed out again after reset
+class	TransientCommandPool
+{
+	CommandPool						pool;
+	std::vector<VkCommandBuffer>	primary;
+	std::vector<VkCommandBuffer>	secondary;
+	size_t							usedPrimary   = 0;
+	size_t							usedSecondary = 0;
+
+public:
+	TransientCommandPool () = default;
+
+	VkCommandPool	getHandle () const
+	{
+		return pool.getHandle ();
+	}
+
+	void	create ( Device& dev, bool graphics = true )
+	{
+		pool.create ( dev, graphics, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT );
+	}
+
+	void	clean ()
+	{
+		primary.clear   ();			// freed together with pool
+		secondary.clear ();
+		pool.clean      ();
+
+		usedPrimary   = 0;
+		usedSecondary = 0;
+	}
+
+			// all buffers got from the pool must be complete
+	void	reset ()
+	{
+		pool.reset ();
+
+		usedPrimary   = 0;
+		usedSecondary = 0;
+	}
+
+			// command buffer in initial state, valid till next reset
+	VkCommandBuffer	get ( VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY )
+	{
+		std::vector<VkCommandBuffer>&	buffers = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? primary     : secondary;
+		size_t&							used    = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? usedPrimary : usedSecondary;
+
+		if ( used == buffers.size () )
+			buffers.push_back ( pool.alloc ( level ) );
+
+		return buffers [used++];
+	}
 };
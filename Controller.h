@@ -27,6 +27,9 @@ public:
 	virtual	void	mouseWheel  ( double xOffset, double yOffset ) {}
 	virtual	void	keyTyped    ( int key, int scancode, int action, int mods ) {}
 	virtual	void	timeElapsed ( double delta ) {}
+
+		// set position from scripted path at time t (seconds), used by benchmark runs
+	virtual	void	followPath ( double t ) {}
 };
 
 class	RotateController : public Controller
@@ -121,4 +124,12 @@ public:
 	}
 
 //	virtual	void	keyTyped    ( int key, int scancode, int action, int mods ) {}
+
+		// turn around vertical axis with slow nodding
+	virtual	void	followPath ( double t ) override
+	{
+		rot.x = 15.0f * (float) sin ( 0.5 * t );
+		rot.y = 0;
+		rot.z = (float) fmod ( 30.0 * t, 360.0 );
+	}
 };
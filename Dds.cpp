@@ -5,6 +5,7 @@
 #include	"Data.h"
 #include	"Device.h"
 #include	"Texture.h"
+#include	"Trace.h"
 
 #pragma once
 
@@ -260,9 +261,12 @@ const uint32_t	DXT3 = 0x33545844;
 const uint32_t	DXT5 = 0x35545844;
 const uint32_t	DX10 = 0x30315844;
 
-static void uploadTextureData ( Device& device, Texture& texture, Buffer& stagingBuffer, VkFormat format, uint32_t arrayLayers, uint32_t mipLevels, int blockSize, int blockWidth = 1, int blockHeight = 1 )
+		// record copy of all mip levels into current upload batch
+static void uploadTextureData ( Device& device, Texture& texture, const void * data, VkDeviceSize size, VkFormat format, uint32_t arrayLayers, uint32_t mipLevels, int blockSize, int blockWidth = 1, int blockHeight = 1 )
 {
-	SingleTimeCommand				cmd ( device );
+	UploadManager&					uploader = *device.getUploader ();
+	UploadManager::Range			staging  = uploader.stage ( size, 4 * blockSize );		// multiple of both 4 and texel block size
+	VkCommandBuffer					cmd      = uploader.getCommandBuffer ();
 	std::vector<VkBufferImageCopy>	regions;
 	auto							offset = 0;
 	auto							w = texture.getWidth  ();
@@ -275,7 +279,7 @@ static void uploadTextureData ( Device& device, Texture& texture, Buffer& stagin
 	{
 		VkBufferImageCopy	region = {};
 
-		region.bufferOffset                    = offset;
+		region.bufferOffset                    = staging.offset + offset;
 		region.bufferRowLength                 = 0;
 		region.bufferImageHeight               = 0;
 		region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -299,13 +303,19 @@ static void uploadTextureData ( Device& device, Texture& texture, Buffer& stagin
 			d /= 2;
 	}
 
-	vkCmdCopyBufferToImage ( cmd.getHandle (), stagingBuffer.getHandle (), texture.getImage ().getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data () );
+	memcpy ( staging.ptr, data, size );
+
+	vkCmdCopyBufferToImage ( cmd, staging.buffer, texture.getImage ().getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data () );
+
+	cmd = uploader.acquireImage ( texture.getImage ().getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, arrayLayers );
 
 	texture.getImage ().transitionLayout ( cmd, texture.getImage ().getFormat (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
 }
 
 void	loadDds ( Device& device, Texture& texture, Data&& data )
 {
+	TraceScope	trace ( "loadDds" );
+
 	if( sizeof( DdsHeader ) != 128 )
 		fatal () << "DdsLoader: incorrect header size" << Log::endl;
 	
@@ -524,11 +534,6 @@ void	loadDds ( Device& device, Texture& texture, Data&& data )
 			d      = depth;
 	auto	offset = 0;
 
-	Buffer	stagingBuffer;
-	
-	stagingBuffer.create ( device, data.getLength () - offs, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-	stagingBuffer.copy   ( data.getPtr ( offs ), data.getLength () - offs );
-
 	if ( isCompressed )
 	{
 		auto	blockPitch = (width + 3) >> 2;
@@ -577,7 +582,7 @@ void	loadDds ( Device& device, Texture& texture, Data&& data )
 			texture.createImageView ( VK_IMAGE_ASPECT_COLOR_BIT, imageViewType );
 	}
 
-	uploadTextureData ( device, texture, stagingBuffer, format, layerCount, mipLevels, blockSize, blockWidth, blockHeight );
+	uploadTextureData ( device, texture, data.getPtr ( offs ), data.getLength () - offs, format, layerCount, mipLevels, blockSize, blockWidth, blockHeight );
 
 }
 
@@ -0,0 +1,115 @@
+//
+// Deferred destruction of Vulkan objects.
+// Objects released during frame N are destroyed once frame N has been
+// retired by GPU (its in-flight fence was waited for), so replacing a
+// resource at runtime does not require vkDeviceWaitIdle
+//
+
+#pragma once
+
+#include	<deque>
+#include	<functional>
+#include	<mutex>
+
+class	DeletionQueue
+{
+	struct	Entry
+	{
+		uint64_t				frame;			// frame in which object was released
+		std::function<void ()>	destroy;
+	};
+
+	std::deque<Entry>	entries;				// in release order, so frames are non-decreasing
+	uint64_t			frame     = 0;			// number of current frame
+	uint64_t			completed = 0;			// all frames up to this one are retired
+	std::mutex			mutex;					// resources may be released from loader threads
+
+public:
+	DeletionQueue  () = default;
+	~DeletionQueue ()
+	{
+		flush ();
+	}
+
+	uint64_t	getFrame () const
+	{
+		return frame;
+	}
+
+	uint64_t	getCompletedFrame () const
+	{
+		return completed;
+	}
+
+	size_t	getPendingCount ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		return entries.size ();
+	}
+
+				// destroy function will be called when frames using object are retired
+	void	push ( std::function<void ()>&& fn )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		entries.push_back ( { frame, std::move ( fn ) } );
+	}
+
+				// call after waiting for fence of the oldest frame in flight,
+				// frames older than framesInFlight are then known to be retired
+	void	beginFrame ( uint32_t framesInFlight )
+	{
+		uint64_t	retired = 0;
+
+		{
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			frame++;
+
+			if ( frame > framesInFlight )
+				retired = frame - framesInFlight;
+		}
+
+		retire ( retired );
+	}
+
+				// destroy everything released in frames up to given one
+	void	retire ( uint64_t lastFrame )
+	{
+		std::deque<Entry>	ready;
+
+		{
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			if ( lastFrame > completed )
+				completed = lastFrame;
+
+				// objects released before first frame wait for it as well
+			while ( completed > 0 && !entries.empty () && entries.front ().frame <= completed )
+			{
+				ready.push_back ( std::move ( entries.front () ) );
+				entries.pop_front ();
+			}
+		}
+
+				// run outside of lock, destroy functions may release other objects
+		for ( auto& e : ready )
+			e.destroy ();
+	}
+
+				// destroy everything, device must be idle
+	void	flush ()
+	{
+		std::deque<Entry>	ready;
+
+		{
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			ready.swap ( entries );
+		}
+
+		for ( auto& e : ready )
+			e.destroy ();
+	}
+};
@@ -0,0 +1,323 @@
+//
+// Growable descriptor set allocator.
+// Keeps a list of descriptor pools sized by per-set ratios of descriptor types,
+// when current pool is exhausted the next one is taken (or created, bigger than
+// the previous one), so callers never pre-count sets or descriptors.
+// Usually sets are not freed one by one, reset returns all pools at once - used for
+// transient sets allocated anew every frame. Allocator made with setFreeable frees
+// single sets too and reuses their room - used for long-lived sets.
+// Pools are switched when their set count is used up; running out of descriptors
+// is reported as VK_ERROR_OUT_OF_POOL_MEMORY with VK_KHR_maintenance1 (core in 1.1)
+// and usually as VK_ERROR_OUT_OF_DEVICE_MEMORY without it, see Device::hasPoolOverflowError
+//
+
+#pragma once
+
+#include	<algorithm>
+#include	<unordered_map>
+#include	<vector>
+#include	"Log.h"
+#include	"Device.h"
+
+struct	DescriptorAllocatorStats
+{
+	uint32_t	pools     = 0;			// pools created
+	uint32_t	usedPools = 0;			// of them holding sets now
+	uint32_t	sets      = 0;			// sets allocated since last reset and not freed
+	uint32_t	totalSets = 0;			// sets allocated during lifetime
+	uint32_t	freed     = 0;			// sets freed one by one
+	uint32_t	overflows = 0;			// times current pool was exhausted
+	uint32_t	resets    = 0;
+};
+
+class	DescriptorAllocator
+{
+	struct	PoolRatio
+	{
+		VkDescriptorType	type;
+		float				perSet;		// descriptors of this type per set
+	};
+
+	struct	Pool
+	{
+		VkDescriptorPool	pool;
+		uint32_t			maxSets;
+		uint32_t			sets;		// allocated from it since last reset and not freed
+	};
+
+	Device						  * device         = nullptr;
+	std::vector<PoolRatio>			ratios;
+	std::vector<Pool>				usedPools;					// last one is current
+	std::vector<Pool>				freePools;					// reset and ready for use
+	uint32_t						setsPerPool    = 64;		// size of the next pool to create
+	uint32_t						maxSetsPerPool = 4096;
+	bool							freeable       = false;		// pools allow vkFreeDescriptorSets
+	std::unordered_map<VkDescriptorSet, VkDescriptorPool>	owners;	// pool of every set, freeable only
+	DescriptorAllocatorStats		stats;
+
+public:
+	DescriptorAllocator ()
+	{
+		ratios =
+		{
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1    },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1    },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4    },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         2    },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          0.5f },
+			{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          0.5f },
+			{ VK_DESCRIPTOR_TYPE_SAMPLER,                0.5f }
+		};
+	}
+
+	~DescriptorAllocator ()
+	{
+		clean ();
+	}
+
+	DescriptorAllocator ( const DescriptorAllocator& ) = delete;
+	DescriptorAllocator& operator = ( const DescriptorAllocator& ) = delete;
+
+	void	create ( Device& dev )
+	{
+		device = &dev;
+	}
+
+	bool	isCreated () const
+	{
+		return device != nullptr;
+	}
+
+			// average count of descriptors of given type per set, used to size new pools
+	DescriptorAllocator&	setRatio ( VkDescriptorType type, float perSet )
+	{
+		for ( auto& r : ratios )
+			if ( r.type == type )
+			{
+				r.perSet = perSet;
+
+				return *this;
+			}
+
+		ratios.push_back ( { type, perSet } );
+
+		return *this;
+	}
+
+			// sets in the first pool and the largest pool, every new pool doubles
+	DescriptorAllocator&	setPoolSize ( uint32_t initialSets, uint32_t maxSets = 4096 )
+	{
+		setsPerPool    = std::max ( 1u, initialSets );
+		maxSetsPerPool = std::max ( setsPerPool, maxSets );
+
+		return *this;
+	}
+
+			// sets may be freed one by one, must be called before first alloc
+	DescriptorAllocator&	setFreeable ( bool flag = true )
+	{
+		assert ( usedPools.empty () && freePools.empty () );
+
+		freeable = flag;
+
+		return *this;
+	}
+
+	DescriptorAllocatorStats	getStats () const
+	{
+		DescriptorAllocatorStats	s = stats;
+
+		s.pools     = (uint32_t)(usedPools.size () + freePools.size ());
+		s.usedPools = (uint32_t) usedPools.size ();
+
+		return s;
+	}
+
+	void	report ( const char * name = "DescriptorAllocator" ) const
+	{
+		DescriptorAllocatorStats	s = getStats ();
+
+		log () << name << ": " << s.pools << " pools (" << s.usedPools << " used), " << s.sets << " sets, "
+			   << s.totalSets << " sets total, " << s.freed << " freed, " << s.overflows << " pool overflows, " << s.resets << " resets" << Log::endl;
+	}
+
+			// destroy all pools together with their sets, GPU must not use them
+	void	clean ()
+	{
+		if ( device == nullptr )
+			return;
+
+		for ( auto& p : usedPools )
+			vkDestroyDescriptorPool ( device->getDevice (), p.pool, nullptr );
+
+		for ( auto& p : freePools )
+			vkDestroyDescriptorPool ( device->getDevice (), p.pool, nullptr );
+
+		usedPools.clear ();
+		freePools.clear ();
+		owners.clear    ();
+
+		stats.sets = 0;
+	}
+
+			// free all sets at once, pools are kept for reuse
+	void	reset ()
+	{
+		if ( usedPools.empty () )
+			return;
+
+		for ( auto& p : usedPools )
+		{
+			vkResetDescriptorPool ( device->getDevice (), p.pool, 0 );
+
+			p.sets = 0;
+
+			freePools.push_back ( p );
+		}
+
+		usedPools.clear ();
+		owners.clear    ();
+
+		stats.sets = 0;
+		stats.resets++;
+	}
+
+			// return single set to its pool, allocator must be freeable
+	void	free ( VkDescriptorSet set )
+	{
+		assert ( freeable );
+
+		auto	it = owners.find ( set );
+
+		if ( it == owners.end () )
+			return;
+
+		vkFreeDescriptorSets ( device->getDevice (), it->second, 1, &set );
+
+		for ( auto& p : usedPools )
+			if ( p.pool == it->second )
+			{
+				p.sets--;
+				break;
+			}
+
+		owners.erase ( it );
+
+		stats.sets--;
+		stats.freed++;
+	}
+
+	VkDescriptorSet	alloc ( VkDescriptorSetLayout layout )
+	{
+		if ( device == nullptr )
+			fatal () << "DescriptorAllocator: alloc called before create" << Log::endl;
+
+		VkDescriptorSet	set = VK_NULL_HANDLE;
+
+		if ( !usedPools.empty () )
+		{
+			if ( tryAlloc ( usedPools.back (), layout, set ) )
+				return set;
+
+					// freed sets leave room in older pools
+			if ( freeable )
+				for ( auto& p : usedPools )
+					if ( tryAlloc ( p, layout, set ) )
+						return set;
+
+			stats.overflows++;
+		}
+
+				// a fresh pool must fit any reasonable layout
+		usedPools.push_back ( nextPool () );
+
+		if ( allocFrom ( usedPools.back (), layout, set ) != VK_SUCCESS )
+			fatal () << "DescriptorAllocator: descriptor set does not fit in an empty pool!" << Log::endl;
+
+		return set;
+	}
+
+private:
+			// false when pool is exhausted
+	bool	tryAlloc ( Pool& pool, VkDescriptorSetLayout layout, VkDescriptorSet& set )
+	{
+				// allocating past maxSets is not an error but invalid usage, so never try it
+		if ( pool.sets >= pool.maxSets )
+			return false;
+
+		VkResult	res = allocFrom ( pool, layout, set );
+
+		if ( res == VK_SUCCESS )
+			return true;
+
+		if ( res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL )
+			return false;
+
+				// before maintenance1 drivers reported exhausted pools as out of memory
+		if ( res == VK_ERROR_OUT_OF_DEVICE_MEMORY && !device->hasPoolOverflowError () )
+			return false;
+
+		fatal () << "DescriptorAllocator: failed to allocate descriptor set!" << Log::endl;
+
+		return false;
+	}
+
+	VkResult	allocFrom ( Pool& pool, VkDescriptorSetLayout layout, VkDescriptorSet& set )
+	{
+		VkDescriptorSetAllocateInfo	allocInfo = {};
+
+		allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool     = pool.pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts        = &layout;
+
+		VkResult	res = vkAllocateDescriptorSets ( device->getDevice (), &allocInfo, &set );
+
+		if ( res == VK_SUCCESS )
+		{
+			pool.sets++;
+			stats.sets++;
+			stats.totalSets++;
+
+			if ( freeable )
+				owners [set] = pool.pool;
+		}
+
+		return res;
+	}
+
+	Pool	nextPool ()
+	{
+		if ( !freePools.empty () )
+		{
+			Pool	p = freePools.back ();
+
+			freePools.pop_back ();
+
+			return p;
+		}
+
+		std::vector<VkDescriptorPoolSize>	sizes;
+		VkDescriptorPoolCreateInfo			poolInfo = {};
+		VkDescriptorPool					pool     = VK_NULL_HANDLE;
+
+		for ( auto& r : ratios )
+			if ( r.perSet > 0 )
+				sizes.push_back ( { r.type, std::max ( 1u, (uint32_t)(r.perSet * setsPerPool) ) } );
+
+		poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags         = freeable ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+		poolInfo.poolSizeCount = (uint32_t) sizes.size ();
+		poolInfo.pPoolSizes    = sizes.data ();
+		poolInfo.maxSets       = setsPerPool;
+
+		if ( vkCreateDescriptorPool ( device->getDevice (), &poolInfo, nullptr, &pool ) != VK_SUCCESS )
+			fatal () << "DescriptorAllocator: failed to create descriptor pool!" << Log::endl;
+
+		Pool	p = { pool, setsPerPool, 0 };
+
+		setsPerPool = std::min ( setsPerPool * 2, maxSetsPerPool );
+
+		return p;
+	}
+};
@@ -3,6 +3,8 @@
 #include	<assert.h>
 #include	"Buffer.h"
 #include	"Texture.h"
+#include	"DescriptorAllocator.h"
+#include	"DescriptorSetCache.h"
 
 class	DescriptorPool
 {
@@ -33,6 +35,24 @@ public:
 		descriptorPool = VK_NULL_HANDLE;
 	}
 
+			// destroy pool (and sets from it) after frames that may still use them are retired
+	void	deferredClean ()
+	{
+		if ( descriptorPool != VK_NULL_HANDLE )
+		{
+			DeletionQueue	  * queue = device->getDeletionQueue ();
+			VkDevice			dev   = device->getDevice ();
+			VkDescriptorPool	pool  = descriptorPool;
+
+			if ( queue != nullptr )
+				queue->push ( [dev, pool] () { vkDestroyDescriptorPool ( dev, pool, nullptr ); } );
+			else
+				vkDestroyDescriptorPool ( dev, pool, nullptr );
+		}
+
+		descriptorPool = VK_NULL_HANDLE;
+	}
+
 	DescriptorPool&	setMaxSets ( uint32_t count )
 	{
 		maxSets = count;
@@ -55,6 +75,21 @@ public:
 		return *this;
 	}
 	
+	DescriptorPool&	setDynamicUniformBufferCount ( uint32_t count )
+	{
+		if ( count > 0 )
+		{
+			VkDescriptorPoolSize	size;
+			
+			size.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			size.descriptorCount = count;
+			
+			poolSizes.push_back ( size );
+		}
+		
+		return *this;
+	}
+	
 	DescriptorPool&	setImageCount ( uint32_t count )
 	{
 		if ( count > 0 )
@@ -106,6 +141,8 @@ class	DescriptorSet
 	Device							  * device              = nullptr;
 	VkDescriptorSet						set                 = VK_NULL_HANDLE;
 	VkDescriptorPool					descriptorPool      = VK_NULL_HANDLE;
+	DescriptorAllocator				  * allocator           = nullptr;		// used instead of pool if set
+	DescriptorSetCache				  * cache               = nullptr;		// set is shared with identical ones if set
 	VkDescriptorSetLayout				descriptorSetLayout = VK_NULL_HANDLE;
 	std::vector<VkWriteDescriptorSet>	writes;
 
@@ -130,6 +167,8 @@ public:
 		}
 
 		writes.clear ();
+
+		set = VK_NULL_HANDLE;		// set itself is freed with its pool
 	}
 
 	DescriptorSet&	setLayout (  Device& dev, VkDescriptorSetLayout descSetLayout, DescriptorPool& descPool )
@@ -137,13 +176,43 @@ public:
 		device              = &dev;
 		descriptorSetLayout = descSetLayout;
 		descriptorPool      = descPool.getHandle ();
+		allocator           = nullptr;
+		cache               = nullptr;
+
+		return *this;
+	}
+
+			// set is taken from allocator, no pool sizes to guess
+	DescriptorSet&	setLayout (  Device& dev, VkDescriptorSetLayout descSetLayout, DescriptorAllocator& descAllocator )
+	{
+		device              = &dev;
+		descriptorSetLayout = descSetLayout;
+		descriptorPool      = VK_NULL_HANDLE;
+		allocator           = &descAllocator;
+		cache               = nullptr;
+
+		return *this;
+	}
+
+			// set is taken from device descriptor set cache by create, identical
+			// bindings give the same set, which is written only once
+	DescriptorSet&	setLayout (  Device& dev, VkDescriptorSetLayout descSetLayout )
+	{
+		if ( dev.getDescriptorSetCache () == nullptr )
+			fatal () << "DescriptorSet: device has no descriptor set cache" << Log::endl;
+
+		device              = &dev;
+		descriptorSetLayout = descSetLayout;
+		descriptorPool      = VK_NULL_HANDLE;
+		allocator           = nullptr;
+		cache               = dev.getDescriptorSetCache ();
 
 		return *this;
 	}
 
 	DescriptorSet&	addBuffer ( uint32_t binding, VkDescriptorType type, Buffer& buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE )
 	{
-		if ( set == VK_NULL_HANDLE )
+		if ( set == VK_NULL_HANDLE && cache == nullptr )
 			alloc ();
 		
 		VkDescriptorBufferInfo * bufferInfo       = new VkDescriptorBufferInfo {};
@@ -168,7 +237,7 @@ public:
 
 	DescriptorSet&	addImage ( uint32_t binding, VkDescriptorType type, Texture& texture, Sampler& sampler )
 	{
-		if ( set == VK_NULL_HANDLE )
+		if ( set == VK_NULL_HANDLE && cache == nullptr )
 			alloc ();
 		
 		assert ( texture.getImageView () != VK_NULL_HANDLE );
@@ -196,6 +265,15 @@ public:
 
 	void	alloc ()
 	{
+		if ( allocator != nullptr )
+		{
+			assert ( device != nullptr && descriptorSetLayout != VK_NULL_HANDLE );
+
+			set = allocator->alloc ( descriptorSetLayout );
+
+			return;
+		}
+
 		assert ( device != nullptr && descriptorPool != VK_NULL_HANDLE && descriptorSetLayout != VK_NULL_HANDLE );
 		
 		VkDescriptorSetAllocateInfo allocInfo = {};
@@ -211,6 +289,13 @@ public:
 	
 	void	create ()
 	{
+		if ( cache != nullptr )
+		{
+			set = cache->get ( descriptorSetLayout, writes );
+
+			return;
+		}
+
 		if ( set == VK_NULL_HANDLE )
 			alloc ();
 				
@@ -0,0 +1,282 @@
+//
+// Device-wide cache of descriptor sets keyed by their contents.
+// Key is made of set layout and every written descriptor (buffer, offset and range
+// or sampler, image view and layout), so sets with identical bindings are allocated
+// and written only once. Buffers, image views, samplers and set layouts report their
+// destruction with forget, entries referencing them are dropped then, so a handle
+// reused by driver never hits a stale set. Dropped sets are freed back to their pools
+// when frames using them retire, so resources recreated on every resize do not grow
+// pool memory
+//
+
+#pragma once
+
+#include	<algorithm>
+#include	<mutex>
+#include	<unordered_map>
+#include	<unordered_set>
+#include	<vector>
+#include	<string.h>
+#include	"Log.h"
+#include	"Device.h"
+#include	"DescriptorAllocator.h"
+#include	"DeletionQueue.h"
+
+struct	DescriptorSetCacheStats
+{
+	uint32_t	requests = 0;			// sets asked for
+	uint32_t	hits     = 0;			// of them found in cache
+	uint32_t	live     = 0;			// sets in cache now
+	uint32_t	dropped  = 0;			// entries dropped as their resources were destroyed
+};
+
+class	DescriptorSetCache
+{
+	typedef std::vector<uint64_t>	Key;
+
+	struct	KeyHash
+	{
+		size_t	operator () ( const Key& key ) const
+		{
+			uint64_t	hash = 14695981039346656037ull;		// FNV-1a over key words
+
+			for ( auto w : key )
+				hash = (hash ^ w) * 1099511628211ull;
+
+			return (size_t) hash;
+		}
+	};
+
+	struct	Entry
+	{
+		VkDescriptorSet			set;
+		std::vector<uint64_t>	handles;		// resources set references, to unlink it from users
+	};
+
+	Device										  * device = nullptr;
+	DescriptorAllocator								allocator;
+	std::unordered_map<Key, Entry, KeyHash>			sets;
+	std::unordered_map<uint64_t, std::unordered_set<Key, KeyHash>>	users;	// keys referencing a handle
+	DescriptorSetCacheStats							stats;
+	std::mutex										mutex;		// resources may be destroyed from loader threads
+
+public:
+	explicit DescriptorSetCache ( Device& dev ) : device ( &dev )
+	{
+		allocator.setFreeable ().create ( dev );
+	}
+
+	DescriptorSetCacheStats	getStats ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		stats.live = (uint32_t) sets.size ();
+
+		return stats;
+	}
+
+	void	report ()
+	{
+		DescriptorSetCacheStats	s = getStats ();
+
+		log () << "DescriptorSetCache: " << s.requests << " requests, " << s.hits << " hits, " << s.live << " sets, "
+			   << s.dropped << " dropped" << Log::endl;
+
+		allocator.report ( "DescriptorSetCache" );
+	}
+
+			// set with given layout and contents, allocated and written on first request;
+			// dstSet of writes is ignored
+	VkDescriptorSet	get ( VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes )
+	{
+		std::vector<uint64_t>	handles;
+		Key						key = makeKey ( layout, writes, handles );
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		stats.requests++;
+
+		auto	it = sets.find ( key );
+
+		if ( it != sets.end () )
+		{
+			stats.hits++;
+
+			return it->second.set;
+		}
+
+		VkDescriptorSet						set = allocator.alloc ( layout );
+		std::vector<VkWriteDescriptorSet>	w   = writes;
+
+		for ( auto& wr : w )
+			wr.dstSet = set;
+
+		vkUpdateDescriptorSets ( device->getDevice (), (uint32_t) w.size (), w.data (), 0, nullptr );
+
+		for ( auto h : handles )
+			users [h].insert ( key );
+
+		sets [key] = { set, handles };
+
+		return set;
+	}
+
+			// resource with this handle is destroyed, drop sets referencing it,
+			// they are freed with the device deletion queue as frames may still use them
+	template <typename Handle>
+	void	forget ( Handle handle )
+	{
+		uint64_t	h = handleBits ( handle );
+
+		if ( h == 0 )
+			return;
+
+		std::lock_guard<std::mutex>	lock ( mutex );
+		auto						it = users.find ( h );
+
+		if ( it == users.end () )
+			return;
+
+		std::vector<VkDescriptorSet>	retired;
+		std::vector<Key>				keys ( it->second.begin (), it->second.end () );	// list shrinks as keys are unlinked
+
+				// unlink every dropped key from all handles it references, so lists of
+				// long-lived resources (layouts, samplers) do not keep dead keys
+		for ( auto& key : keys )
+		{
+			auto	entry = sets.find ( key );
+
+			if ( entry == sets.end () )
+				continue;
+
+			for ( auto other : entry->second.handles )
+			{
+				auto	u = users.find ( other );
+
+				if ( u == users.end () )
+					continue;
+
+				u->second.erase ( key );
+
+				if ( u->second.empty () )
+					users.erase ( u );
+			}
+
+			retired.push_back ( entry->second.set );
+			sets.erase        ( entry );
+
+			stats.dropped++;
+		}
+
+		users.erase ( h );
+
+		DeletionQueue * queue = device->getDeletionQueue ();
+
+		if ( retired.empty () )
+			return;
+
+		if ( queue == nullptr )
+		{
+			for ( auto set : retired )
+				allocator.free ( set );
+
+			return;
+		}
+
+		uint32_t	resets = allocator.getStats ().resets;
+
+				// sets freed by clear meanwhile may have been handed out again
+		queue->push ( [this, retired, resets] ()
+		{
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			if ( allocator.getStats ().resets == resets )
+				for ( auto set : retired )
+					allocator.free ( set );
+		} );
+	}
+
+			// for resources that know their device only, cache may be absent
+	template <typename Handle>
+	static void	forget ( Device * dev, Handle handle )
+	{
+		if ( dev != nullptr && dev->getDescriptorSetCache () != nullptr )
+			dev->getDescriptorSetCache ()->forget ( handle );
+	}
+
+			// drop all sets and return their pools, GPU must not use them
+	void	clear ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		sets.clear      ();
+		users.clear     ();
+		allocator.reset ();
+	}
+
+private:
+	template <typename Handle>
+	static uint64_t	handleBits ( Handle handle )
+	{
+		uint64_t	bits = 0;
+
+		memcpy ( &bits, &handle, sizeof ( handle ) );	// handles are pointers or 64-bit ints depending on platform
+
+		return bits;
+	}
+
+			// writes are put in binding order, so same contents give the same key
+	static Key	makeKey ( VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes, std::vector<uint64_t>& handles )
+	{
+		std::vector<const VkWriteDescriptorSet *>	order;
+		Key											key;
+
+		for ( auto& w : writes )
+			order.push_back ( &w );
+
+		std::sort ( order.begin (), order.end (), [] ( const VkWriteDescriptorSet * a, const VkWriteDescriptorSet * b )
+		{
+			return a->dstBinding < b->dstBinding || (a->dstBinding == b->dstBinding && a->dstArrayElement < b->dstArrayElement);
+		} );
+
+		key.push_back     ( handleBits ( layout ) );
+		handles.push_back ( handleBits ( layout ) );
+
+		for ( auto w : order )
+		{
+			key.push_back ( ((uint64_t) w->dstBinding << 32) | w->dstArrayElement );
+			key.push_back ( ((uint64_t) w->descriptorType << 32) | w->descriptorCount );
+
+			for ( uint32_t i = 0; i < w->descriptorCount; i++ )
+				if ( w->pBufferInfo != nullptr )
+				{
+					const VkDescriptorBufferInfo&	b = w->pBufferInfo [i];
+
+					key.push_back     ( handleBits ( b.buffer ) );
+					key.push_back     ( b.offset );
+					key.push_back     ( b.range  );
+					handles.push_back ( handleBits ( b.buffer ) );
+				}
+				else
+				if ( w->pImageInfo != nullptr )
+				{
+					const VkDescriptorImageInfo&	im = w->pImageInfo [i];
+
+					key.push_back ( handleBits ( im.sampler   ) );
+					key.push_back ( handleBits ( im.imageView ) );
+					key.push_back ( im.imageLayout );
+
+					if ( im.sampler != VK_NULL_HANDLE )
+						handles.push_back ( handleBits ( im.sampler ) );
+
+					if ( im.imageView != VK_NULL_HANDLE )
+						handles.push_back ( handleBits ( im.imageView ) );
+				}
+		}
+
+				// a handle used by several descriptors is recorded once
+		std::sort ( handles.begin (), handles.end () );
+		handles.erase ( std::unique ( handles.begin (), handles.end () ), handles.end () );
+
+		return key;
+	}
+};
@@ -2,9 +2,20 @@
 #pragma once
 
 #include	<vector>
+#include	<map>
+#include	<mutex>
+#include	<assert.h>
 
 #define DEFAULT_FENCE_TIMEOUT 100000000000
 
+class	MemoryAllocator;
+class	UploadManager;
+class	GeometryHeap;
+class	DeletionQueue;
+class	PipelineCache;
+class	ShaderCache;
+class	DescriptorSetCache;
+
 struct QueueFamilyIndices 
 {
 	enum
@@ -15,6 +26,7 @@ struct QueueFamilyIndices
 	uint32_t graphicsFamily = noValue;
 	uint32_t presentFamily  = noValue;
 	uint32_t computeFamily  = noValue;
+	uint32_t transferFamily = noValue;		// transfer-only (DMA) family if any, otherwise graphics one
 
 	bool isComplete() const
 	{
@@ -32,10 +44,25 @@ class	Device
 	VkQueue							graphicsQueue       = VK_NULL_HANDLE;
 	VkQueue							presentQueue        = VK_NULL_HANDLE;
 	VkQueue							computeQueue        = VK_NULL_HANDLE;
+	VkQueue							transferQueue       = VK_NULL_HANDLE;
 	VkCommandPool					commandPool         = VK_NULL_HANDLE;
+	VkCommandPool					transferCommandPool = VK_NULL_HANDLE;
 	uint32_t						graphicsFamilyIndex = UINT32_MAX;
 	uint32_t						presentFamilyIndex  = UINT32_MAX;
 	uint32_t						computeFamilyIndex  = UINT32_MAX;
+	uint32_t						transferFamilyIndex = UINT32_MAX;
+	MemoryAllocator				  * allocator           = nullptr;		// sub-allocates device memory for buffers and images
+	UploadManager				  * uploader            = nullptr;		// batches staging copies to device-local memory
+	GeometryHeap				  * geometryHeap        = nullptr;		// shared vertex/index buffers for meshes, owned by app
+	DeletionQueue				  * deletionQueue       = nullptr;		// objects waiting for frames using them to retire
+	PipelineCache				  * pipelineCache       = nullptr;		// shared by all pipelines, kept on disk
+	ShaderCache					  * shaderCache         = nullptr;		// shader modules shared by pipelines
+	DescriptorSetCache			  * descriptorSetCache  = nullptr;		// sets shared by identical bindings
+	VkPhysicalDeviceProperties		properties          = {};			// limits, vendor and device id
+	uint32_t						apiVersion          = VK_API_VERSION_1_0;	// used by app, lower of instance and device ones
+	bool							descriptorIndexing  = false;		// bindless descriptor arrays are enabled
+	bool							poolOverflowError   = false;		// VK_KHR_maintenance1 or 1.1, exhausted pools return VK_ERROR_OUT_OF_POOL_MEMORY
+	mutable std::map<VkQueue, std::mutex>	queueMutexes;				// queues must be externally synchronized, families may share queue
 
 	friend class VulkanWindow;
 	
@@ -43,6 +70,9 @@ public:
 	Device  () {}
 	~Device () {}
 
+	Device ( const Device& ) = delete;
+	Device& operator = ( const Device& ) = delete;
+
 	VkDevice	getDevice () const
 	{
 		return device;
@@ -58,6 +88,16 @@ public:
 		return physicalDevice;
 	}
 	
+	const VkPhysicalDeviceProperties&	getProperties () const
+	{
+		return properties;
+	}
+	
+	const VkPhysicalDeviceLimits&	getLimits () const
+	{
+		return properties.limits;
+	}
+	
 	VkQueue	getGraphicsQueue () const
 	{
 		return graphicsQueue;
@@ -73,6 +113,43 @@ public:
 		return computeQueue;
 	}
 	
+	VkQueue	getTransferQueue () const
+	{
+		return transferQueue;
+	}
+	
+			// lock for queue submits and presents from any thread
+	std::mutex&	getQueueMutex ( VkQueue queue ) const
+	{
+		auto	it = queueMutexes.find ( queue );
+
+		assert ( it != queueMutexes.end () );
+
+		return it->second;
+	}
+
+			// vkQueueSubmit under queue lock, so loader threads may submit too
+	VkResult	submit ( VkQueue queue, uint32_t count, const VkSubmitInfo * submits, VkFence fence ) const
+	{
+		std::lock_guard<std::mutex>	lock ( getQueueMutex ( queue ) );
+
+		return vkQueueSubmit ( queue, count, submits, fence );
+	}
+
+	VkResult	present ( VkQueue queue, const VkPresentInfoKHR * presentInfo ) const
+	{
+		std::lock_guard<std::mutex>	lock ( getQueueMutex ( queue ) );
+
+		return vkQueuePresentKHR ( queue, presentInfo );
+	}
+
+	VkResult	waitIdle ( VkQueue queue ) const
+	{
+		std::lock_guard<std::mutex>	lock ( getQueueMutex ( queue ) );
+
+		return vkQueueWaitIdle ( queue );
+	}
+
 	uint32_t	getGraphicsFamilyIndex () const
 	{
 		return graphicsFamilyIndex;
@@ -88,9 +165,84 @@ public:
 		return computeFamilyIndex;
 	}
 	
+	uint32_t	getTransferFamilyIndex () const
+	{
+		return transferFamilyIndex;
+	}
+	
+			// true if uploads go to separate DMA queue and need ownership transfers
+	bool	hasTransferQueue () const
+	{
+		return transferFamilyIndex != graphicsFamilyIndex;
+	}
+	
 	VkCommandPool	getCommandPool () const
 	{
 		return commandPool;
+	}
+
+			// pool for transfer family, buffers from it can be reset individually
+	VkCommandPool	getTransferCommandPool () const
+	{
+		return transferCommandPool;
+	}
+
+	MemoryAllocator * getAllocator () const
+	{
+		return allocator;
+	}
+
+	UploadManager * getUploader () const
+	{
+		return uploader;
+	}
+
+	DeletionQueue * getDeletionQueue () const
+	{
+		return deletionQueue;
+	}
+
+	GeometryHeap * getGeometryHeap () const
+	{
+		return geometryHeap;
+	}
+
+	PipelineCache * getPipelineCache () const
+	{
+		return pipelineCache;
+	}
+
+	ShaderCache * getShaderCache () const
+	{
+		return shaderCache;
+	}
+
+	uint32_t	getApiVersion () const
+	{
+		return apiVersion;
+	}
+
+			// allocating from exhausted descriptor pool is a defined error, not invalid usage
+	bool	hasPoolOverflowError () const
+	{
+		return poolOverflowError;
+	}
+
+			// runtime-sized, partially bound, update-after-bind sampled image arrays can be used
+	bool	hasDescriptorIndexing () const
+	{
+		return descriptorIndexing;
+	}
+
+	DescriptorSetCache * getDescriptorSetCache () const
+	{
+		return descriptorSetCache;
+	}
+
+			// meshes created after this call take their geometry from the heap, nullptr turns it off
+	void	setGeometryHeap ( GeometryHeap * heap )
+	{
+		geometryHeap = heap;
 	}
 /*
 	void	pickPhysicalDevice  ();
@@ -110,6 +262,14 @@ public:
 
 		vkGetPhysicalDeviceQueueFamilyProperties ( device, &queueFamilyCount, queueFamilies.data () );
 
+				// look for family with transfer but without graphics and compute
+		for ( uint32_t j = 0; j < queueFamilyCount; j++ )
+			if ( (queueFamilies [j].queueFlags & VK_QUEUE_TRANSFER_BIT) && (queueFamilies [j].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0 )
+			{
+				indices.transferFamily = j;
+				break;
+			}
+
 		for ( const auto& queueFamily : queueFamilies )
 		{
 			if ( indices.graphicsFamily == QueueFamilyIndices::noValue && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT )
@@ -127,11 +287,14 @@ public:
 				indices.presentFamily = i;
 
 			if ( indices.isComplete () )
-				return indices;
+				break;
 
 			i++;
 		}
 
+		if ( indices.transferFamily == QueueFamilyIndices::noValue )
+			indices.transferFamily = indices.graphicsFamily;
+
 		return indices;
 	}
 };
\ No newline at end of file
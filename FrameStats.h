@@ -0,0 +1,425 @@
+//
+// Frame time statistics: rolling window of frame times with histogram,
+// percentiles, hitch counters and per-phase breakdown of every frame.
+// Other timings (e.g. GPU scopes) can be added as named series.
+// Can export window as CSV and summary as JSON
+//
+
+#pragma once
+
+#include	<chrono>
+#include	<vector>
+#include	<array>
+#include	<map>
+#include	<string>
+#include	<algorithm>
+#include	<cmath>
+#include	<stdio.h>
+#include	"Log.h"
+
+		// rolling window of named timing, e.g. GPU time of a pass
+class	TimingSeries
+{
+	std::vector<float>	values;					// ring, ms
+	size_t				head  = 0;
+	size_t				count = 0;
+	uint64_t			total = 0;				// samples ever added
+	float				last  = 0;
+
+public:
+	TimingSeries ( size_t capacity = 1000 ) : values ( std::max ( capacity, (size_t) 1 ), 0.0f ) {}
+
+	void	add ( float t )
+	{
+		values [head] = t;
+		head          = (head + 1) % values.size ();
+		last          = t;
+		count         = std::min ( count + 1, values.size () );
+		total++;
+	}
+
+	float	getLast () const
+	{
+		return last;
+	}
+
+	uint64_t	getTotal () const
+	{
+		return total;
+	}
+
+	float	getMean () const
+	{
+		double	sum = 0;
+
+		for ( size_t i = 0; i < count; i++ )
+			sum += values [i];
+
+		return count > 0 ? (float)(sum / count) : 0.0f;
+	}
+
+			// exact, sorts copy of window - intended for reports, not per frame
+	float	percentile ( double fraction ) const
+	{
+		if ( count == 0 )
+			return 0;
+
+		std::vector<float>	sorted ( values.begin (), values.begin () + count );
+		size_t				index = (size_t) std::ceil ( fraction * count );
+
+		std::sort ( sorted.begin (), sorted.end () );
+
+		return sorted [std::min ( std::max ( index, (size_t) 1 ) - 1, count - 1 )];
+	}
+};
+
+class	FrameStats
+{
+public:
+	enum	Phase
+	{
+		otherPhase = 0,				// events, idle and app code outside of drawFrame
+		acquirePhase,				// waiting for frame fence and acquiring image
+		recordPhase,				// housekeeping, updating and recording commands
+		submitPhase,				// queue submission
+		presentPhase,
+		numPhases
+	};
+
+	typedef std::chrono::steady_clock				Clock;
+	typedef std::array<float, numPhases>			PhaseTimes;
+
+private:
+	enum
+	{
+		bucketsPerMs = 10,			// histogram resolution is 0.1 ms
+		maxMs        = 250,			// longer frames go to the last bucket
+		numBuckets   = bucketsPerMs * maxMs + 1
+	};
+
+	size_t					capacity    = 1000;		// frames in rolling window
+	size_t					head        = 0;		// next slot to write
+	size_t					count       = 0;		// frames in window
+	uint64_t				totalFrames = 0;
+	double					totalTime   = 0;		// ms, all frames
+	float					worstFrame  = 0;		// ms, all frames
+	std::vector<float>		frameTimes;				// ring, ms
+	std::vector<PhaseTimes>	phaseTimes;				// ring, ms
+	std::vector<uint32_t>	histogram;				// of frames in window
+	std::vector<float>		hitchThresholds = { 33.4f, 50.0f, 100.0f };
+	std::vector<uint64_t>	hitchCounts;			// all frames
+	std::map<std::string, TimingSeries>	series;		// named timings, GPU scopes and alike
+	PhaseTimes				current     = {};		// phases of frame in progress
+	Phase					phase       = otherPhase;
+	Clock::time_point		frameStart;
+	Clock::time_point		phaseStart;
+	bool					started     = false;
+
+public:
+	FrameStats ()
+	{
+		reset ();
+	}
+
+	FrameStats&	setCapacity ( size_t frames )
+	{
+		capacity = std::max ( frames, (size_t) 1 );
+		reset ();
+
+		return *this;
+	}
+
+			// frames longer than each threshold (in ms) are counted as hitches
+	FrameStats&	setHitchThresholds ( const std::vector<float>& thresholds )
+	{
+		hitchThresholds = thresholds;
+		hitchCounts.assign ( hitchThresholds.size (), 0 );
+
+		return *this;
+	}
+
+	const std::vector<float>&	getHitchThresholds () const
+	{
+		return hitchThresholds;
+	}
+
+	uint64_t	getHitchCount ( size_t i ) const
+	{
+		return hitchCounts [i];
+	}
+
+	uint64_t	getTotalFrames () const
+	{
+		return totalFrames;
+	}
+
+	size_t	getWindowSize () const
+	{
+		return count;
+	}
+
+	void	reset ()
+	{
+		frameTimes.assign  ( capacity, 0.0f );
+		phaseTimes.assign  ( capacity, PhaseTimes () );
+		histogram.assign   ( numBuckets, 0 );
+		hitchCounts.assign ( hitchThresholds.size (), 0 );
+
+		head        = 0;
+		count       = 0;
+		totalFrames = 0;
+		totalTime   = 0;
+		worstFrame  = 0;
+		started     = false;
+
+		series.clear ();
+	}
+
+			// add sample of named timing (in ms), series is created on first use
+	void	addSample ( const std::string& name, float t )
+	{
+		auto	it = series.find ( name );
+
+		if ( it == series.end () )
+			it = series.emplace ( name, TimingSeries ( capacity ) ).first;
+
+		it->second.add ( t );
+	}
+
+	const std::map<std::string, TimingSeries>&	getSeries () const
+	{
+		return series;
+	}
+
+			// call once per frame at the same point, ends previous frame
+	void	beginFrame ()
+	{
+		Clock::time_point	now = Clock::now ();
+
+		if ( started )
+		{
+			current [phase] += ms ( phaseStart, now );
+			add ( ms ( frameStart, now ), current );
+		}
+
+		started    = true;
+		frameStart = now;
+		phaseStart = now;
+		phase      = otherPhase;
+		current    = PhaseTimes ();
+	}
+
+			// time from now on goes to given phase
+	void	beginPhase ( Phase p )
+	{
+		Clock::time_point	now = Clock::now ();
+
+		current [phase] += ms ( phaseStart, now );
+		phaseStart       = now;
+		phase            = p;
+	}
+
+			// frame time in ms such that given fraction (0..1) of frames in window are not longer,
+			// accurate to histogram resolution
+	float	percentile ( double fraction ) const
+	{
+		if ( count == 0 )
+			return 0;
+
+		uint64_t	target = (uint64_t) std::ceil ( fraction * count );
+		uint64_t	sum    = 0;
+
+		if ( target < 1 )
+			target = 1;
+
+		for ( size_t i = 0; i < histogram.size (); i++ )
+			if ( (sum += histogram [i]) >= target )
+				return (float)(i + 1) / bucketsPerMs;
+
+		return (float) maxMs;
+	}
+
+	float	getMax () const				// in window
+	{
+		float	m = 0;
+
+		for ( size_t i = 0; i < count; i++ )
+			m = std::max ( m, frameTimes [i] );
+
+		return m;
+	}
+
+	float	getWorst () const			// over all frames
+	{
+		return worstFrame;
+	}
+
+	float	getMean () const			// over all frames
+	{
+		return totalFrames > 0 ? (float)(totalTime / totalFrames) : 0.0f;
+	}
+
+			// mean of last frames, for FPS display
+	float	getRecentMean ( size_t frames ) const
+	{
+		frames = std::min ( frames, count );
+
+		if ( frames == 0 )
+			return 0;
+
+		double	sum = 0;
+
+		for ( size_t i = 1; i <= frames; i++ )
+			sum += frameTimes [(head + capacity - i) % capacity];
+
+		return (float)(sum / frames);
+	}
+
+			// mean time of phase over window
+	float	getPhaseMean ( Phase p ) const
+	{
+		if ( count == 0 )
+			return 0;
+
+		double	sum = 0;
+
+		for ( size_t i = 0; i < count; i++ )
+			sum += phaseTimes [i][p];
+
+		return (float)(sum / count);
+	}
+
+	static const char * phaseName ( Phase p )
+	{
+		static const char * names [numPhases] = { "other", "acquire", "record", "submit", "present" };
+
+		return names [p];
+	}
+
+	void	report () const
+	{
+		log () << "Frames: " << totalFrames << ", mean " << getMean () << " ms, p50 " << percentile ( 0.5 ) << " ms, p95 " << percentile ( 0.95 )
+		       << " ms, p99 " << percentile ( 0.99 ) << " ms, max " << getWorst () << " ms" << Log::endl;
+
+		for ( size_t i = 0; i < hitchThresholds.size (); i++ )
+			log () << "Frames over " << hitchThresholds [i] << " ms: " << hitchCounts [i] << Log::endl;
+
+		for ( int p = 0; p < numPhases; p++ )
+			log () << "Phase " << phaseName ( (Phase) p ) << ": " << getPhaseMean ( (Phase) p ) << " ms" << Log::endl;
+
+		for ( auto& it : series )
+			log () << it.first << ": mean " << it.second.getMean () << " ms, p50 " << it.second.percentile ( 0.5 ) << " ms, p95 " 
+			       << it.second.percentile ( 0.95 ) << " ms, p99 " << it.second.percentile ( 0.99 ) << " ms" << Log::endl;
+	}
+
+			// frames of window in order, one per line with phase breakdown
+	bool	exportCsv ( const std::string& fileName ) const
+	{
+		FILE * fp = fopen ( fileName.c_str (), "w" );
+
+		if ( fp == nullptr )
+			return false;
+
+		fprintf ( fp, "frame,total_ms" );
+
+		for ( int p = 0; p < numPhases; p++ )
+			fprintf ( fp, ",%s_ms", phaseName ( (Phase) p ) );
+
+		fprintf ( fp, "\n" );
+
+		for ( size_t i = 0; i < count; i++ )
+		{
+			size_t	index = (head + capacity - count + i) % capacity;
+
+			fprintf ( fp, "%llu,%.4f", (unsigned long long)(totalFrames - count + i), frameTimes [index] );
+
+			for ( int p = 0; p < numPhases; p++ )
+				fprintf ( fp, ",%.4f", phaseTimes [index][p] );
+
+			fprintf ( fp, "\n" );
+		}
+
+		fclose ( fp );
+
+		return true;
+	}
+
+	bool	exportJson ( const std::string& fileName ) const
+	{
+		FILE * fp = fopen ( fileName.c_str (), "w" );
+
+		if ( fp == nullptr )
+			return false;
+
+		writeJson ( fp );
+		fprintf   ( fp, "\n" );
+		fclose    ( fp );
+
+		return true;
+	}
+
+			// summary as JSON object, without trailing newline so it can be nested
+	void	writeJson ( FILE * fp ) const
+	{
+		fprintf ( fp, "{\n  \"frames\": %llu,\n  \"window\": %llu,\n", (unsigned long long) totalFrames, (unsigned long long) count );
+		fprintf ( fp, "  \"mean_ms\": %.4f,\n  \"p50_ms\": %.4f,\n  \"p95_ms\": %.4f,\n  \"p99_ms\": %.4f,\n  \"max_ms\": %.4f,\n",
+				  getMean (), percentile ( 0.5 ), percentile ( 0.95 ), percentile ( 0.99 ), getWorst () );
+		fprintf ( fp, "  \"hitches\": [" );
+
+		for ( size_t i = 0; i < hitchThresholds.size (); i++ )
+			fprintf ( fp, "%s{ \"threshold_ms\": %.2f, \"count\": %llu }", i > 0 ? ", " : " ", hitchThresholds [i], (unsigned long long) hitchCounts [i] );
+
+		fprintf ( fp, " ],\n  \"phases_ms\": {" );
+
+		for ( int p = 0; p < numPhases; p++ )
+			fprintf ( fp, "%s\"%s\": %.4f", p > 0 ? ", " : " ", phaseName ( (Phase) p ), getPhaseMean ( (Phase) p ) );
+
+		fprintf ( fp, " },\n  \"series\": {" );
+
+		bool	first = true;
+
+		for ( auto& it : series )
+		{
+			fprintf ( fp, "%s\n    \"%s\": { \"samples\": %llu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f }",
+					  first ? "" : ",", it.first.c_str (), (unsigned long long) it.second.getTotal (), it.second.getMean (),
+					  it.second.percentile ( 0.5 ), it.second.percentile ( 0.95 ), it.second.percentile ( 0.99 ) );
+
+			first = false;
+		}
+
+		fprintf ( fp, "%s}\n}", series.empty () ? " " : "\n  " );
+	}
+
+private:
+	static float	ms ( Clock::time_point from, Clock::time_point to )
+	{
+		return std::chrono::duration<float, std::milli> ( to - from ).count ();
+	}
+
+	static size_t	bucket ( float t )
+	{
+		return std::min ( (size_t)(t * bucketsPerMs), (size_t)(numBuckets - 1) );
+	}
+
+	void	add ( float t, const PhaseTimes& phases )
+	{
+		if ( count == capacity )			// evict oldest frame from histogram
+			histogram [bucket ( frameTimes [head] )]--;
+		else
+			count++;
+
+		frameTimes [head] = t;
+		phaseTimes [head] = phases;
+		head              = (head + 1) % capacity;
+
+		histogram [bucket ( t )]++;
+
+		totalFrames++;
+		totalTime += t;
+		worstFrame = std::max ( worstFrame, t );
+
+		for ( size_t i = 0; i < hitchThresholds.size (); i++ )
+			if ( t > hitchThresholds [i] )
+				hitchCounts [i]++;
+	}
+};
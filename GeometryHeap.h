@@ -0,0 +1,240 @@
+//
+// Shared vertex/index buffer pair for many meshes.
+// Meshes get ranges of it (first-fit with merging of freed ranges),
+// so a whole scene is drawn with one vertex/index buffer bind and
+// per-mesh firstIndex/vertexOffset, which also suits indirect draws
+//
+
+#pragma once
+
+#include	<map>
+#include	"Log.h"
+#include	"Device.h"
+#include	"Buffer.h"
+#include	"UploadManager.h"
+
+struct	GeometryRange
+{
+	uint32_t	firstVertex = 0;		// used as vertexOffset in draw calls
+	uint32_t	numVertices = 0;
+	uint32_t	firstIndex  = 0;
+	uint32_t	numIndices  = 0;
+
+	bool	isEmpty () const
+	{
+		return numVertices == 0 && numIndices == 0;
+	}
+};
+
+class	GeometryHeap
+{
+	typedef std::map<uint32_t, uint32_t>	FreeList;		// start -> count, sorted by start
+
+	Device		  * device       = nullptr;
+	Buffer			vertexBuf;
+	Buffer			indexBuf;
+	uint32_t		vertexStride = 0;
+	uint32_t		maxVertices  = 0;
+	uint32_t		maxIndices   = 0;
+	uint32_t		usedVertices = 0;
+	uint32_t		usedIndices  = 0;
+	FreeList		freeVertices;
+	FreeList		freeIndices;
+
+public:
+	GeometryHeap () = default;
+	~GeometryHeap ()
+	{
+		clean ();
+	}
+
+	VkBuffer	getVertexBuffer () const
+	{
+		return vertexBuf.getHandle ();
+	}
+
+	VkBuffer	getIndexBuffer () const
+	{
+		return indexBuf.getHandle ();
+	}
+
+	uint32_t	getVertexStride () const
+	{
+		return vertexStride;
+	}
+
+	uint32_t	getUsedVertices () const
+	{
+		return usedVertices;
+	}
+
+	uint32_t	getUsedIndices () const
+	{
+		return usedIndices;
+	}
+
+	uint32_t	getMaxVertices () const
+	{
+		return maxVertices;
+	}
+
+	uint32_t	getMaxIndices () const
+	{
+		return maxIndices;
+	}
+
+	void	clean ()
+	{
+		vertexBuf.clean ();
+		indexBuf.clean  ();
+		freeVertices.clear ();
+		freeIndices.clear  ();
+
+		maxVertices  = 0;
+		maxIndices   = 0;
+		usedVertices = 0;
+		usedIndices  = 0;
+	}
+
+				// indices are 32-bit, stride is size of one vertex
+	bool	create ( Device& dev, uint32_t stride, uint32_t numVertices, uint32_t numIndices )
+	{
+		device       = &dev;
+		vertexStride = stride;
+		maxVertices  = numVertices;
+		maxIndices   = numIndices;
+		usedVertices = 0;
+		usedIndices  = 0;
+
+		vertexBuf.create ( dev, (VkDeviceSize) stride * numVertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		indexBuf.create  ( dev, (VkDeviceSize) sizeof ( uint32_t ) * numIndices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+		freeVertices.clear ();
+		freeIndices.clear  ();
+
+		freeVertices [0] = numVertices;
+		freeIndices  [0] = numIndices;
+
+		return true;
+	}
+
+				// reserve ranges and upload data into them, indices are relative to first vertex of the range,
+				// returns false (and leaves heap unchanged) when there is no room
+	bool	alloc ( const void * vertices, uint32_t numVertices, const void * indices, uint32_t numIndices, GeometryRange& range )
+	{
+		uint32_t	firstVertex, firstIndex;
+
+		if ( !allocRange ( freeVertices, numVertices, firstVertex ) )
+			return false;
+
+		if ( !allocRange ( freeIndices, numIndices, firstIndex ) )
+		{
+			freeRange ( freeVertices, firstVertex, numVertices );
+			return false;
+		}
+
+		range.firstVertex = firstVertex;
+		range.numVertices = numVertices;
+		range.firstIndex  = firstIndex;
+		range.numIndices  = numIndices;
+		usedVertices     += numVertices;
+		usedIndices      += numIndices;
+
+		if ( numVertices > 0 )
+			device->getUploader ()->uploadBuffer ( vertexBuf, vertices, (VkDeviceSize) vertexStride * numVertices, (VkDeviceSize) vertexStride * firstVertex );
+
+		if ( numIndices > 0 )
+			device->getUploader ()->uploadBuffer ( indexBuf,  indices,  sizeof ( uint32_t ) * numIndices, sizeof ( uint32_t ) * firstIndex );
+
+		return true;
+	}
+
+				// range must not be used by commands still in flight
+	void	free ( GeometryRange& range )
+	{
+		if ( range.isEmpty () )
+			return;
+
+		freeRange ( freeVertices, range.firstVertex, range.numVertices );
+		freeRange ( freeIndices,  range.firstIndex,  range.numIndices  );
+
+		usedVertices -= range.numVertices;
+		usedIndices  -= range.numIndices;
+		range         = GeometryRange ();
+	}
+
+				// bind both buffers once, then draw ranges with their firstIndex/vertexOffset
+	void	bind ( VkCommandBuffer commandBuffer ) const
+	{
+		VkBuffer		vertexBuffers [] = { vertexBuf.getHandle () };
+		VkDeviceSize	offsets       [] = { 0 };
+
+		vkCmdBindVertexBuffers ( commandBuffer, 0, 1, vertexBuffers, offsets );
+		vkCmdBindIndexBuffer   ( commandBuffer, indexBuf.getHandle (), 0, VK_INDEX_TYPE_UINT32 );
+	}
+
+	static VkDrawIndexedIndirectCommand	drawCommand ( const GeometryRange& range, uint32_t instanceCount = 1, uint32_t firstInstance = 0 )
+	{
+		VkDrawIndexedIndirectCommand	cmd = {};
+
+		cmd.indexCount    = range.numIndices;
+		cmd.instanceCount = instanceCount;
+		cmd.firstIndex    = range.firstIndex;
+		cmd.vertexOffset  = (int32_t) range.firstVertex;
+		cmd.firstInstance = firstInstance;
+
+		return cmd;
+	}
+
+private:
+	static bool	allocRange ( FreeList& freeList, uint32_t count, uint32_t& start )
+	{
+		start = 0;
+
+		if ( count == 0 )
+			return true;
+
+		for ( auto it = freeList.begin (); it != freeList.end (); ++it )
+			if ( it->second >= count )
+			{
+				uint32_t	rest = it->second - count;
+
+				start = it->first;
+				freeList.erase ( it );
+
+				if ( rest > 0 )
+					freeList [start + count] = rest;
+
+				return true;
+			}
+
+		return false;
+	}
+
+				// return range to list, merging it with adjacent free ranges
+	static void	freeRange ( FreeList& freeList, uint32_t start, uint32_t count )
+	{
+		if ( count == 0 )
+			return;
+
+		auto	it   = freeList.insert ( std::make_pair ( start, count ) ).first;
+		auto	next = std::next ( it );
+
+		if ( next != freeList.end () && it->first + it->second == next->first )
+		{
+			it->second += next->second;
+			freeList.erase ( next );
+		}
+
+		if ( it != freeList.begin () )
+		{
+			auto	prev = std::prev ( it );
+
+			if ( prev->first + prev->second == it->first )
+			{
+				prev->second += it->second;
+				freeList.erase ( it );
+			}
+		}
+	}
+};
@@ -0,0 +1,222 @@
+//
+// GPU profiler built on timestamp queries.
+// Command buffer regions are wrapped into named scopes, every slot (e.g. swap chain
+// image or pre-recorded command buffer) has its own range of queries, so results are
+// read back later without waiting, when the slot's commands are known to be complete
+//
+
+#pragma once
+
+#include	<string>
+#include	<vector>
+#include	"Log.h"
+#include	"Device.h"
+#include	"FrameStats.h"
+
+class	GpuProfiler
+{
+	Device			  * device    = nullptr;
+	VkQueryPool			pool      = VK_NULL_HANDLE;
+	uint32_t			numSlots  = 0;
+	uint32_t			maxScopes = 0;
+	double				period    = 1;				// nanoseconds per tick
+	uint64_t			validMask = ~0ull;			// from timestampValidBits
+	bool				supported = false;
+	std::string			prefix    = "gpu ";			// prepended to scope names in stats
+	std::vector<std::string>			names;		// of scopes
+	std::vector<std::vector<bool>>		used;		// [slot][scope] recorded into slot
+	std::vector<bool>					pending;	// slot submitted, results not read yet
+	std::vector<float>					last;		// last time of every scope, ms
+	std::vector<uint64_t>				data;		// readback, value + availability per query
+
+public:
+	GpuProfiler () = default;
+	~GpuProfiler ()
+	{
+		clean ();
+	}
+
+	bool	isSupported () const
+	{
+		return supported;
+	}
+
+	GpuProfiler&	setPrefix ( const std::string& p )
+	{
+		prefix = p;
+
+		return *this;
+	}
+
+	void	clean ()
+	{
+		if ( pool != VK_NULL_HANDLE )
+			vkDestroyQueryPool ( device->getDevice (), pool, nullptr );
+
+		pool      = VK_NULL_HANDLE;
+		supported = false;
+	}
+
+			// familyIndex is the queue family command buffers will be submitted to
+	bool	create ( Device& dev, uint32_t slots, uint32_t scopes, uint32_t familyIndex )
+	{
+		uint32_t	familyCount = 0;
+
+		device    = &dev;
+		numSlots  = slots;
+		maxScopes = scopes;
+		period    = dev.getLimits ().timestampPeriod;
+
+		vkGetPhysicalDeviceQueueFamilyProperties ( dev.getPhysicalDevice (), &familyCount, nullptr );
+
+		std::vector<VkQueueFamilyProperties>	families ( familyCount );
+
+		vkGetPhysicalDeviceQueueFamilyProperties ( dev.getPhysicalDevice (), &familyCount, families.data () );
+
+		uint32_t	validBits = familyIndex < familyCount ? families [familyIndex].timestampValidBits : 0;
+
+		if ( validBits == 0 )
+		{
+			log () << "GpuProfiler: timestamps are not supported on queue family " << familyIndex << Log::endl;
+
+			return false;
+		}
+
+		validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+		VkQueryPoolCreateInfo	info = {};
+
+		info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+		info.queryCount = 2 * numSlots * maxScopes;
+
+		if ( vkCreateQueryPool ( dev.getDevice (), &info, nullptr, &pool ) != VK_SUCCESS )
+		{
+			log () << "GpuProfiler: cannot create query pool, profiling is off" << Log::endl;
+
+			pool = VK_NULL_HANDLE;
+
+			return false;
+		}
+
+		used.assign    ( numSlots, std::vector<bool> ( maxScopes, false ) );
+		pending.assign ( numSlots, false );
+		last.assign    ( maxScopes, 0.0f );
+		data.resize    ( 2 * 2 * maxScopes );
+
+		supported = true;
+
+		return true;
+	}
+
+			// id of named scope, created on first call
+	uint32_t	scope ( const std::string& name )
+	{
+		for ( size_t i = 0; i < names.size (); i++ )
+			if ( names [i] == name )
+				return (uint32_t) i;
+
+		if ( names.size () >= maxScopes )
+			fatal () << "GpuProfiler: too many scopes, " << name << Log::endl;
+
+		names.push_back ( name );
+
+		return (uint32_t)(names.size () - 1);
+	}
+
+	const std::string&	getName ( uint32_t scopeId ) const
+	{
+		return names [scopeId];
+	}
+
+			// last measured time of scope in ms
+	float	getTime ( uint32_t scopeId ) const
+	{
+		return last [scopeId];
+	}
+
+			// record outside of render pass in the first command buffer submitted for slot,
+			// scopes of the slot may be written by several (pre-recorded) command buffers
+	void	reset ( VkCommandBuffer cmd, uint32_t slot )
+	{
+		if ( !supported )
+			return;
+
+		vkCmdResetQueryPool ( cmd, pool, firstQuery ( slot ), 2 * maxScopes );
+	}
+
+	void	begin ( VkCommandBuffer cmd, uint32_t slot, uint32_t scopeId, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT )
+	{
+		if ( !supported )
+			return;
+
+		used [slot][scopeId] = true;
+
+		vkCmdWriteTimestamp ( cmd, stage, pool, firstQuery ( slot ) + 2 * scopeId );
+	}
+
+	void	end ( VkCommandBuffer cmd, uint32_t slot, uint32_t scopeId, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT )
+	{
+		if ( !supported )
+			return;
+
+		vkCmdWriteTimestamp ( cmd, stage, pool, firstQuery ( slot ) + 2 * scopeId + 1 );
+	}
+
+			// call after command buffer for slot was submitted
+	void	submitted ( uint32_t slot )
+	{
+		if ( supported )
+			pending [slot] = true;
+	}
+
+			// read results of all finished slots without waiting, add them to stats
+	void	collect ( FrameStats * stats = nullptr )
+	{
+		if ( !supported )
+			return;
+
+		for ( uint32_t slot = 0; slot < numSlots; slot++ )
+		{
+			if ( !pending [slot] )
+				continue;
+
+			VkResult	res = vkGetQueryPoolResults ( device->getDevice (), pool, firstQuery ( slot ), 2 * maxScopes,
+													  data.size () * sizeof ( uint64_t ), data.data (), 2 * sizeof ( uint64_t ),
+													  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+
+			if ( res != VK_SUCCESS && res != VK_NOT_READY )
+				continue;
+
+			bool	ready = true;
+
+			for ( uint32_t s = 0; s < names.size () && ready; s++ )
+				if ( used [slot][s] && data [4*s + 3] == 0 )		// end timestamp not available yet
+					ready = false;
+
+			if ( !ready )
+				continue;
+
+			for ( uint32_t s = 0; s < names.size (); s++ )
+			{
+				if ( !used [slot][s] || data [4*s + 1] == 0 )
+					continue;
+
+				uint64_t	ticks = (data [4*s + 2] - data [4*s]) & validMask;		// handles wrap around
+
+				last [s] = (float)(ticks * period * 1e-6);
+
+				if ( stats != nullptr )
+					stats->addSample ( prefix + names [s], last [s] );
+			}
+
+			pending [slot] = false;
+		}
+	}
+
+private:
+	uint32_t	firstQuery ( uint32_t slot ) const
+	{
+		return 2 * maxScopes * slot;
+	}
+};
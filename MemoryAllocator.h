@@ -0,0 +1,375 @@
+//
+// Device memory sub-allocator.
+// Big blocks of device memory are allocated per memory type and split with a buddy allocator,
+// so every Buffer and Image does not need its own vkAllocateMemory call
+//
+
+#pragma once
+
+#include	<vector>
+#include	<set>
+#include	<mutex>
+#include	<algorithm>
+#include	"Log.h"
+#include	"Device.h"
+
+struct	MemoryBlock;
+
+struct	MemoryAllocation
+{
+	VkDeviceMemory	memory     = VK_NULL_HANDLE;
+	VkDeviceSize	offset     = 0;
+	VkDeviceSize	size       = 0;			// size requested by the resource
+	uint8_t       * mapped     = nullptr;	// host pointer (already offset), only for host-visible memory
+	MemoryBlock   * block      = nullptr;	// nullptr for dedicated allocations
+	uint32_t		order      = 0;			// buddy order of the allocated node
+	uint32_t		memoryType = 0;
+};
+
+struct	MemoryStats
+{
+	uint32_t		blockCount      = 0;	// number of big blocks
+	uint32_t		allocationCount = 0;	// number of live sub-allocations
+	uint32_t		dedicatedCount  = 0;	// number of allocations too big for a block
+	VkDeviceSize	blockBytes      = 0;	// total size of all blocks
+	VkDeviceSize	dedicatedBytes  = 0;	// total size of dedicated allocations
+	VkDeviceSize	usedBytes       = 0;	// bytes requested by resources
+	VkDeviceSize	wastedBytes     = 0;	// bytes lost when rounding up to buddy node size
+	VkDeviceSize	freeBytes       = 0;	// free bytes in all blocks
+	VkDeviceSize	largestFree     = 0;	// largest free node
+
+		// 0 when all free space is in one node, close to 1 when it is badly fragmented
+	float	fragmentation () const
+	{
+		return freeBytes > 0 ? 1.0f - float ( largestFree ) / float ( freeBytes ) : 0.0f;
+	}
+};
+
+struct	MemoryBlock
+{
+	VkDeviceMemory						memory     = VK_NULL_HANDLE;
+	VkDeviceSize						size       = 0;
+	uint32_t							memoryType = 0;
+	bool								linear     = true;		// buffers and linear images only, see bufferImageGranularity
+	uint8_t                           * mapped     = nullptr;	// persistent mapping for host-visible blocks
+	uint32_t							numAllocs  = 0;
+	std::vector<std::set<VkDeviceSize>>	freeLists;				// offsets of free nodes for every order
+};
+
+class	MemoryAllocator
+{
+	Device							  * device        = nullptr;
+	VkPhysicalDeviceMemoryProperties	memProperties = {};
+	VkDeviceSize						blockSize     = 64 * 1024 * 1024;
+	std::vector<MemoryBlock *>			blocks;
+	MemoryStats							stats;				// only counters updated on alloc/free are valid here
+	std::mutex							mutex;
+
+public:
+	enum
+	{
+		minNodeSize = 256				// smallest node, also the minimal alignment we give out
+	};
+
+	MemoryAllocator ( Device& dev, VkDeviceSize preferredBlockSize = 64 * 1024 * 1024 ) : device ( &dev ), blockSize ( preferredBlockSize )
+	{
+		vkGetPhysicalDeviceMemoryProperties ( device->getPhysicalDevice (), &memProperties );
+	}
+
+	~MemoryAllocator ()
+	{
+		clean ();
+	}
+
+	void	clean ()
+	{
+		if ( stats.allocationCount > 0 || stats.dedicatedCount > 0 )
+			log () << "MemoryAllocator: " << stats.allocationCount + stats.dedicatedCount << " allocations are still alive" << Log::endl;
+
+		for ( auto block : blocks )
+			freeBlock ( block );
+
+		blocks.clear ();
+
+		stats = MemoryStats ();
+	}
+
+	const VkPhysicalDeviceMemoryProperties&	getMemoryProperties () const
+	{
+		return memProperties;
+	}
+
+	bool	isHostVisible ( uint32_t memoryType ) const
+	{
+		return (memProperties.memoryTypes [memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	}
+
+	bool	isHostCoherent ( uint32_t memoryType ) const
+	{
+		return (memProperties.memoryTypes [memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	}
+
+		// linear is true for buffers and linear-tiled images, false for optimal-tiled images
+	bool	alloc ( const VkMemoryRequirements& memRequirements, uint32_t memoryType, bool linear, MemoryAllocation& allocation )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		VkDeviceSize	need     = std::max ( std::max ( memRequirements.size, memRequirements.alignment ), (VkDeviceSize) minNodeSize );
+		VkDeviceSize	typeSize = blockSizeForType ( memoryType );
+
+		allocation            = MemoryAllocation ();
+		allocation.size       = memRequirements.size;
+		allocation.memoryType = memoryType;
+
+		if ( need > typeSize / 2 )				// too big, give it its own VkDeviceMemory
+			return allocDedicated ( memRequirements.size, memoryType, allocation );
+
+		uint32_t	order = orderForSize ( need );
+
+		for ( auto block : blocks )
+			if ( block->memoryType == memoryType && block->linear == linear && allocFromBlock ( block, order, allocation.offset ) )
+			{
+				bindToBlock ( block, order, allocation );
+
+				return true;
+			}
+
+		MemoryBlock * block = createBlock ( typeSize, memoryType, linear );
+
+		if ( block == nullptr || !allocFromBlock ( block, order, allocation.offset ) )
+			return false;
+
+		bindToBlock ( block, order, allocation );
+
+		return true;
+	}
+
+	void	free ( MemoryAllocation& allocation )
+	{
+		if ( allocation.memory == VK_NULL_HANDLE )
+			return;
+
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		if ( allocation.block == nullptr )
+		{
+			if ( allocation.mapped != nullptr )
+				vkUnmapMemory ( device->getDevice (), allocation.memory );
+
+			vkFreeMemory ( device->getDevice (), allocation.memory, nullptr );
+
+			stats.dedicatedCount--;
+			stats.dedicatedBytes -= allocation.size;
+			allocation            = MemoryAllocation ();
+
+			return;
+		}
+
+		MemoryBlock * block    = allocation.block;
+		uint32_t	  order    = allocation.order;
+		uint32_t	  maxOrder = (uint32_t) block->freeLists.size () - 1;
+		VkDeviceSize  offset   = allocation.offset;
+
+		stats.allocationCount--;
+		stats.usedBytes   -= allocation.size;
+		stats.wastedBytes -= nodeSize ( order ) - allocation.size;
+
+				// merge with free buddies as long as we can
+		while ( order < maxOrder )
+		{
+			VkDeviceSize	buddy = offset ^ nodeSize ( order );
+			auto			it    = block->freeLists [order].find ( buddy );
+
+			if ( it == block->freeLists [order].end () )
+				break;
+
+			block->freeLists [order].erase ( it );
+
+			offset = std::min ( offset, buddy );
+			order++;
+		}
+
+		block->freeLists [order].insert ( offset );
+		block->numAllocs--;
+
+		allocation = MemoryAllocation ();
+
+				// return empty blocks to the driver, but keep the last one of this kind to avoid thrashing
+		if ( block->numAllocs == 0 )
+		{
+			int	sameKind = 0;
+
+			for ( auto b : blocks )
+				if ( b->memoryType == block->memoryType && b->linear == block->linear )
+					sameKind++;
+
+			if ( sameKind > 1 )
+			{
+				blocks.erase ( std::find ( blocks.begin (), blocks.end (), block ) );
+				freeBlock    ( block );
+			}
+		}
+	}
+
+	MemoryStats	getStats ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		MemoryStats	res = stats;
+
+		res.blockCount  = (uint32_t) blocks.size ();
+		res.blockBytes  = 0;
+		res.freeBytes   = 0;
+		res.largestFree = 0;
+
+		for ( auto block : blocks )
+		{
+			res.blockBytes += block->size;
+
+			for ( uint32_t order = 0; order < block->freeLists.size (); order++ )
+				if ( !block->freeLists [order].empty () )
+				{
+					res.freeBytes  += block->freeLists [order].size () * nodeSize ( order );
+					res.largestFree = std::max ( res.largestFree, nodeSize ( order ) );
+				}
+		}
+
+		return res;
+	}
+
+	void	dumpStats ()
+	{
+		MemoryStats	s = getStats ();
+
+		log () << "MemoryAllocator: " << s.blockCount << " blocks (" << s.blockBytes / 1024 << " KB), "
+			   << s.allocationCount << " allocations (" << s.usedBytes / 1024 << " KB used, " << s.wastedBytes / 1024 << " KB wasted), "
+			   << s.dedicatedCount << " dedicated (" << s.dedicatedBytes / 1024 << " KB), fragmentation " << s.fragmentation () << Log::endl;
+	}
+
+private:
+	static VkDeviceSize	nodeSize ( uint32_t order )
+	{
+		return VkDeviceSize ( minNodeSize ) << order;
+	}
+
+	static uint32_t	orderForSize ( VkDeviceSize size )
+	{
+		uint32_t	order = 0;
+
+		while ( nodeSize ( order ) < size )
+			order++;
+
+		return order;
+	}
+
+			// block size is a power of two that does not eat too much of a small heap
+	VkDeviceSize	blockSizeForType ( uint32_t memoryType ) const
+	{
+		VkDeviceSize	heapSize = memProperties.memoryHeaps [memProperties.memoryTypes [memoryType].heapIndex].size;
+		VkDeviceSize	size     = nodeSize ( 0 );
+
+		while ( 2 * size <= blockSize && 2 * size <= heapSize / 8 )
+			size *= 2;
+
+		return size;
+	}
+
+	bool	allocDedicated ( VkDeviceSize size, uint32_t memoryType, MemoryAllocation& allocation )
+	{
+		VkMemoryAllocateInfo	allocInfo = {};
+
+		allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize  = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		if ( vkAllocateMemory ( device->getDevice (), &allocInfo, nullptr, &allocation.memory ) != VK_SUCCESS )
+			return false;
+
+		if ( isHostVisible ( memoryType ) )
+			vkMapMemory ( device->getDevice (), allocation.memory, 0, VK_WHOLE_SIZE, 0, (void **) &allocation.mapped );
+
+		stats.dedicatedCount++;
+		stats.dedicatedBytes += size;
+
+		return true;
+	}
+
+	MemoryBlock * createBlock ( VkDeviceSize size, uint32_t memoryType, bool linear )
+	{
+		VkMemoryAllocateInfo	allocInfo = {};
+		MemoryBlock           * block     = new MemoryBlock;
+
+		allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize  = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		if ( vkAllocateMemory ( device->getDevice (), &allocInfo, nullptr, &block->memory ) != VK_SUCCESS )
+		{
+			log () << "MemoryAllocator: cannot allocate block of " << size << " bytes" << Log::endl;
+			delete block;
+
+			return nullptr;
+		}
+
+				// host-visible blocks stay mapped all the time, so sub-allocations never call vkMapMemory
+		if ( isHostVisible ( memoryType ) )
+			vkMapMemory ( device->getDevice (), block->memory, 0, VK_WHOLE_SIZE, 0, (void **) &block->mapped );
+
+		block->size       = size;
+		block->memoryType = memoryType;
+		block->linear     = linear;
+
+		block->freeLists.resize ( orderForSize ( size ) + 1 );
+		block->freeLists.back ().insert ( 0 );
+		blocks.push_back ( block );
+
+		return block;
+	}
+
+	void	freeBlock ( MemoryBlock * block )
+	{
+		if ( block->mapped != nullptr )
+			vkUnmapMemory ( device->getDevice (), block->memory );
+
+		vkFreeMemory ( device->getDevice (), block->memory, nullptr );
+
+		delete block;
+	}
+
+	bool	allocFromBlock ( MemoryBlock * block, uint32_t order, VkDeviceSize& offset )
+	{
+		uint32_t	k = order;
+
+		while ( k < block->freeLists.size () && block->freeLists [k].empty () )
+			k++;
+
+		if ( k >= block->freeLists.size () )
+			return false;
+
+		offset = *block->freeLists [k].begin ();
+
+		block->freeLists [k].erase ( block->freeLists [k].begin () );
+
+				// split down to requested order, upper halves go to free lists
+		while ( k > order )
+		{
+			k--;
+			block->freeLists [k].insert ( offset + nodeSize ( k ) );
+		}
+
+		return true;
+	}
+
+	void	bindToBlock ( MemoryBlock * block, uint32_t order, MemoryAllocation& allocation )
+	{
+		allocation.memory = block->memory;
+		allocation.block  = block;
+		allocation.order  = order;
+		allocation.mapped = block->mapped != nullptr ? block->mapped + allocation.offset : nullptr;
+
+		block->numAllocs++;
+		stats.allocationCount++;
+		stats.usedBytes   += allocation.size;
+		stats.wastedBytes += nodeSize ( order ) - allocation.size;
+	}
+};
@@ -0,0 +1,236 @@
+//
+// Multithreaded recording of render pass contents into secondary command buffers.
+// Every thread has its own command pool and a secondary command buffer per slot
+// (e.g. swap chain image), draw list is split into ranges recorded in parallel,
+// results are executed from the primary command buffer with vkCmdExecuteCommands
+//
+
+#pragma once
+
+#include	<algorithm>
+#include	<condition_variable>
+#include	<functional>
+#include	<memory>
+#include	<mutex>
+#include	<string>
+#include	<thread>
+#include	<vector>
+#include	"Log.h"
+#include	"Device.h"
+#include	"CommandPool.h"
+#include	"Trace.h"
+
+class	ParallelRecorder
+{
+public:
+			// record draws [first, last) into cmd, called from several threads at once,
+			// state is not inherited, so it must bind pipeline and descriptor sets itself
+	typedef std::function<void ( VkCommandBuffer cmd, uint32_t first, uint32_t last )>	RecordFunc;
+
+private:
+	struct	Worker
+	{
+		CommandPool						pool;
+		std::vector<VkCommandBuffer>	buffers;		// secondary, one per slot
+		std::vector<bool>				recorded;		// buffer of slot got commands from last record
+		uint32_t						first = 0;		// range of current job
+		uint32_t						last  = 0;
+	};
+
+	Device					  * device   = nullptr;
+	std::vector<std::unique_ptr<Worker>>	workers;	// worker 0 is the calling thread
+	std::vector<std::thread>	threads;				// run the other workers
+	std::mutex					mutex;
+	std::condition_variable		startCv;
+	std::condition_variable		doneCv;
+	uint64_t					generation = 0;			// incremented for every job
+	uint32_t					busy       = 0;			// threads still recording current job
+	bool						quit       = false;
+	uint32_t					minDraws   = 64;		// per thread, short lists use fewer threads
+
+										// current job, read by workers
+	const RecordFunc			  * func        = nullptr;
+	VkCommandBufferInheritanceInfo	inheritance = {};
+	uint32_t						slot        = 0;
+
+public:
+	ParallelRecorder () = default;
+	~ParallelRecorder ()
+	{
+		clean ();
+	}
+
+	ParallelRecorder ( const ParallelRecorder& ) = delete;
+	ParallelRecorder& operator = ( const ParallelRecorder& ) = delete;
+
+	uint32_t	getThreadCount () const
+	{
+		return (uint32_t) workers.size ();
+	}
+
+	ParallelRecorder&	setMinDrawsPerThread ( uint32_t count )
+	{
+		minDraws = count > 0 ? count : 1;
+
+		return *this;
+	}
+
+			// threadCount of 0 uses all hardware threads, calling thread is one of them
+	void	create ( Device& dev, uint32_t threadCount = 0 )
+	{
+		device = &dev;
+
+		if ( threadCount == 0 )
+			threadCount = std::max ( 1u, std::thread::hardware_concurrency () );
+
+		for ( uint32_t i = 0; i < threadCount; i++ )
+		{
+			workers.emplace_back ( new Worker );
+			workers.back ()->pool.create ( dev, true, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT );
+		}
+
+		for ( uint32_t i = 1; i < threadCount; i++ )
+			threads.emplace_back ( &ParallelRecorder::workerLoop, this, i, generation );
+	}
+
+			// stop threads and destroy pools with all secondary buffers, none may be pending
+	void	clean ()
+	{
+		{
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			quit = true;
+		}
+
+		startCv.notify_all ();
+
+		for ( auto& t : threads )
+			t.join ();
+
+		threads.clear ();
+		workers.clear ();			// pools free their command buffers
+
+		quit = false;
+	}
+
+			// record count draws for slot into secondary buffers continuing given subpass,
+			// returns when all of them are recorded. Previous contents of slot's buffers
+			// must not be pending execution
+	void	record ( uint32_t slotIndex, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer, uint32_t count, const RecordFunc& fn )
+	{
+		TraceScope	trace ( "ParallelRecorder::record" );
+
+		if ( workers.empty () )
+			fatal () << "ParallelRecorder: record called before create" << Log::endl;
+
+		allocSlot ( slotIndex );
+
+		uint32_t	used = std::min ( (uint32_t) workers.size (), std::max ( 1u, (count + minDraws - 1) / minDraws ) );
+
+		for ( uint32_t i = 0; i < workers.size (); i++ )
+		{
+			workers [i]->first = i < used ? (uint32_t)((uint64_t) count * i       / used) : count;
+			workers [i]->last  = i < used ? (uint32_t)((uint64_t) count * (i + 1) / used) : count;
+		}
+
+		inheritance             = {};
+		inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass  = renderPass;
+		inheritance.subpass     = subpass;
+		inheritance.framebuffer = framebuffer;
+		func                    = &fn;
+		slot                    = slotIndex;
+
+		{
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			busy = (uint32_t) threads.size ();
+			generation++;
+		}
+
+		startCv.notify_all ();
+		recordRange        ( 0 );
+
+		std::unique_lock<std::mutex>	lock ( mutex );
+
+		doneCv.wait ( lock, [this] { return busy == 0; } );
+
+		func = nullptr;
+	}
+
+			// call inside render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+	void	execute ( VkCommandBuffer primary, uint32_t slotIndex ) const
+	{
+		std::vector<VkCommandBuffer>	cmds;
+
+		for ( auto& w : workers )
+			if ( slotIndex < w->recorded.size () && w->recorded [slotIndex] )
+				cmds.push_back ( w->buffers [slotIndex] );
+
+		if ( !cmds.empty () )
+			vkCmdExecuteCommands ( primary, (uint32_t) cmds.size (), cmds.data () );
+	}
+
+private:
+	void	allocSlot ( uint32_t slotIndex )
+	{
+		for ( auto& w : workers )
+			while ( w->buffers.size () <= slotIndex )
+			{
+				w->buffers.push_back  ( w->pool.alloc ( VK_COMMAND_BUFFER_LEVEL_SECONDARY ) );
+				w->recorded.push_back ( false );
+			}
+	}
+
+	void	recordRange ( uint32_t index )
+	{
+		Worker&	w = *workers [index];
+
+		w.recorded [slot] = w.first < w.last;
+
+		if ( !w.recorded [slot] )
+			return;
+
+		TraceScope					trace ( "ParallelRecorder::recordRange" );
+		VkCommandBuffer				cmd       = w.buffers [slot];
+		VkCommandBufferBeginInfo	beginInfo = {};
+
+		beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritance;
+
+		if ( vkBeginCommandBuffer ( cmd, &beginInfo ) != VK_SUCCESS )
+			fatal () << "ParallelRecorder: failed to begin secondary command buffer" << Log::endl;
+
+		(*func) ( cmd, w.first, w.last );
+
+		if ( vkEndCommandBuffer ( cmd ) != VK_SUCCESS )
+			fatal () << "ParallelRecorder: failed to record secondary command buffer" << Log::endl;
+	}
+
+	void	workerLoop ( uint32_t index, uint64_t seen )
+	{
+		Trace::setThreadName ( "recorder " + std::to_string ( index ) );
+
+		for ( ; ; )
+		{
+			{
+				std::unique_lock<std::mutex>	lock ( mutex );
+
+				startCv.wait ( lock, [&] { return quit || generation != seen; } );
+
+				if ( quit )
+					return;
+
+				seen = generation;
+			}
+
+			recordRange ( index );
+
+			std::lock_guard<std::mutex>	lock ( mutex );
+
+			if ( --busy == 0 )
+				doneCv.notify_one ();
+		}
+	}
+};
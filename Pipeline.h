@@ -1,13 +1,18 @@
 
 #pragma once
 
+#include	<algorithm>
 #include	"Data.h"
 #include	"Texture.h"
+#include	"Trace.h"
+#include	"PipelineCache.h"
+#include	"ShaderCache.h"
 
 class	Shader 
 {
 	VkShaderModule	shader = VK_NULL_HANDLE;
 	VkDevice		device = VK_NULL_HANDLE;
+	ShaderCache   * cache  = nullptr;			// module is owned by cache, if set
 	
 public:
 	Shader  () {}
@@ -29,10 +34,39 @@ public:
 	
 	void	clean ()
 	{
+		if ( shader != VK_NULL_HANDLE && cache != nullptr )
+			cache->release ( shader );
+		else
 		if ( shader != VK_NULL_HANDLE )
 			vkDestroyShaderModule ( device, shader, nullptr );
 		
 		shader = VK_NULL_HANDLE;
+		cache  = nullptr;
+	}
+
+			// take module from device shader cache when there is one
+	void	load ( Device& dev, const std::string& fileName )
+	{
+		clean ();
+
+		if ( dev.getShaderCache () == nullptr )
+		{
+			Data	data ( fileName );
+		
+			if ( data.getLength () < 1 )
+				fatal () << "Shader: cannot open " << fileName << Log::endl;
+
+			load ( dev.getDevice (), data );
+
+			return;
+		}
+
+		device = dev.getDevice ();
+		cache  = dev.getShaderCache ();
+		shader = cache->acquire ( fileName );
+
+		if ( shader == VK_NULL_HANDLE )
+			fatal () << "Shader: cannot open " << fileName << Log::endl;
 	}
 
 	void	load ( VkDevice dev, Data& data )
@@ -260,20 +294,32 @@ public:
 	}
 };
 
+		// ranges must be 4-byte aligned and fit into maxPushConstantsSize of device
+inline	void	checkPushConstantRanges ( const Device& dev, const std::vector<VkPushConstantRange>& ranges )
+{
+	for ( auto& r : ranges )
+		if ( r.size == 0 || r.offset % 4 != 0 || r.size % 4 != 0 || r.offset + r.size > dev.getLimits ().maxPushConstantsSize )
+			fatal () << "Pipeline: invalid push constant range " << r.offset << "+" << r.size << ", device allows " << dev.getLimits ().maxPushConstantsSize << " bytes" << Log::endl;
+}
+
 class	DescSetLayout
 {
 	std::vector<VkDescriptorSetLayoutBinding>	descr;
+	std::vector<uint32_t>						bindingFlags;		// VkDescriptorBindingFlagsEXT for every binding
 	VkDescriptorSetLayout						descriptorSetLayout = VK_NULL_HANDLE;
 	VkDevice									device              = VK_NULL_HANDLE;
+	Device									  * owner               = nullptr;		// notified when layout is destroyed
 
 public:
 	DescSetLayout () = default;
 	DescSetLayout ( DescSetLayout&& dsl )
 	{
 		device = dsl.device;
+		owner  = dsl.owner;
 		
 		std::swap ( descriptorSetLayout, dsl.descriptorSetLayout );
 		std::swap ( descr,               dsl.descr );
+		std::swap ( bindingFlags,        dsl.bindingFlags );
 	}
 	
 	~DescSetLayout ()
@@ -286,9 +332,11 @@ public:
 		assert ( descriptorSetLayout == VK_NULL_HANDLE );		// we should not have ready layout (or may be descroy it ?)
 		
 		device = dsl.device;
+		owner  = dsl.owner;
 		
 		std::swap ( descriptorSetLayout, dsl.descriptorSetLayout );
 		std::swap ( descr,               dsl.descr );
+		std::swap ( bindingFlags,        dsl.bindingFlags );
 	}
 	
 	uint32_t	count () const
@@ -308,12 +356,15 @@ public:
 	
 	void	clean ()
 	{
+		DescriptorSetCache::forget ( owner, descriptorSetLayout );
+
 		if ( descriptorSetLayout != VK_NULL_HANDLE )
 			vkDestroyDescriptorSetLayout ( device, descriptorSetLayout, nullptr );
 
 		descriptorSetLayout = VK_NULL_HANDLE;
 
-		descr.clear ();
+		descr.clear        ();
+		bindingFlags.clear ();
 	}
 	
 	DescSetLayout&	add ( uint32_t binding, VkDescriptorType type, VkShaderStageFlags flags, uint32_t cnt = 1 )
@@ -326,20 +377,50 @@ public:
 		layoutBinding.pImmutableSamplers = nullptr;
 		layoutBinding.stageFlags         = flags;
 		
-		descr.push_back ( layoutBinding );
+		descr.push_back        ( layoutBinding );
+		bindingFlags.push_back ( 0 );
 		
+		return *this;
+	}
+
+			// array of up to maxCount descriptors, actual size is given when set is allocated,
+			// unused elements may stay unwritten and elements may be updated while set is bound.
+			// Must be the last binding, requires Device::hasDescriptorIndexing
+	DescSetLayout&	addBindless ( uint32_t binding, VkDescriptorType type, VkShaderStageFlags flags, uint32_t maxCount )
+	{
+		add ( binding, type, flags, maxCount );
+
+#ifdef	VK_EXT_descriptor_indexing
+		bindingFlags.back () = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT |
+							   VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+#endif
+
 		return *this;
 	}
 	
-	void	create ( VkDevice dev )
+	void	create ( Device& dev )
 	{
 		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 		
 		layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 		layoutInfo.bindingCount = count ();
 		layoutInfo.pBindings    = data  ();
+		owner                   = &dev;
+
+#ifdef	VK_EXT_descriptor_indexing
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT	flagsInfo = {};
+
+		if ( std::find_if ( bindingFlags.begin (), bindingFlags.end (), [] ( uint32_t f ) { return f != 0; } ) != bindingFlags.end () )
+		{
+			flagsInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+			flagsInfo.bindingCount  = count ();
+			flagsInfo.pBindingFlags = bindingFlags.data ();
+			layoutInfo.pNext        = &flagsInfo;
+			layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		}
+#endif
 
-		if ( vkCreateDescriptorSetLayout ( device = dev, &layoutInfo, nullptr, &descriptorSetLayout ) != VK_SUCCESS )
+		if ( vkCreateDescriptorSetLayout ( device = dev.getDevice (), &layoutInfo, nullptr, &descriptorSetLayout ) != VK_SUCCESS )
 			fatal () << "DescSetLayout: failed to create descriptor set layout!";
 	}
 };
@@ -401,8 +482,12 @@ class	GraphicsPipeline
 	BindingDescription							vertexBindings;
 	AttrDescription								vertexAttrs;
 	std::vector<DescSetLayout>					descLayouts;
+	std::vector<VkDynamicState>					dynamicStates;		// set at record time, not baked into pipeline
+	std::vector<VkPushConstantRange>			pushConstantRanges;
 	
 	VkDevice			device         = VK_NULL_HANDLE;
+	Device			  * owner          = nullptr;			// shaders are taken from its cache
+	PipelineCache	  * cache          = nullptr;
 	VkPipelineLayout 	pipelineLayout = VK_NULL_HANDLE;
 	VkPipeline			pipeline       = VK_NULL_HANDLE;
 
@@ -426,6 +511,8 @@ public:
 		vertexBindings.clean ();
 		vertexAttrs.clean    ();
 
+		pushConstantRanges.clear ();
+
 		for ( auto& d : descLayouts )
 			d.clean ();
 	}
@@ -450,6 +537,8 @@ public:
 	GraphicsPipeline&	setDevice ( Device& dev )
 	{
 		device = dev.getDevice ();
+		owner  = &dev;
+		cache  = dev.getPipelineCache ();
 
 		return *this;
 	}
@@ -491,60 +580,35 @@ public:
 
 	GraphicsPipeline&	setVertexShader ( const std::string& fileName ) 
 	{
-		Data	data ( fileName );
-		
-		if ( data.getLength () < 1 )
-			fatal () << "Shader: cannot open " << fileName << Log::endl;
-		
-		vertShader.load ( device, data );
+		vertShader.load ( *owner, fileName );
 		
 		return *this; 
 	}
 
 	GraphicsPipeline&	setFragmentShader ( const std::string& fileName )
 	{ 
-		Data	data ( fileName );
-		
-		if ( data.getLength () < 1 )
-			fatal () << "Shader: cannot open " << fileName << Log::endl;
-		
-		fragShader.load ( device, data );
+		fragShader.load ( *owner, fileName );
 		
 		return *this; 
 	}
 
 	GraphicsPipeline&	setGeometryShader ( const std::string& fileName )
 	{ 
-		Data	data ( fileName );
-		
-		if ( data.getLength () < 1 )
-			fatal () << "Shader: cannot open " << fileName << Log::endl;
-		
-		geomShader.load ( device, data );
+		geomShader.load ( *owner, fileName );
 		
 		return *this; 
 	}
 
 	GraphicsPipeline&	setTessControlShader ( const std::string& fileName )
 	{ 
-		Data	data ( fileName );
-		
-		if ( data.getLength () < 1 )
-			fatal () << "Shader: cannot open " << fileName << Log::endl;
-		
-		tessControlShader.load ( device, data );
+		tessControlShader.load ( *owner, fileName );
 		
 		return *this; 
 	}
 
 	GraphicsPipeline&	setTessEvalShader ( const std::string& fileName )
 	{ 
-		Data	data ( fileName );
-		
-		if ( data.getLength () < 1 )
-			fatal () << "Shader: cannot open " << fileName << Log::endl;
-		
-		tessEvalShader.load ( device, data );
+		tessEvalShader.load ( *owner, fileName );
 		
 		return *this; 
 	}
@@ -655,6 +719,53 @@ public:
 		return *this;
 	}
 
+	GraphicsPipeline&	addDynamicState ( VkDynamicState state )
+	{
+		if ( std::find ( dynamicStates.begin (), dynamicStates.end (), state ) == dynamicStates.end () )
+			dynamicStates.push_back ( state );
+
+		return *this;
+	}
+
+			// viewport and scissor are set by setViewport when recording, so pipeline
+			// does not depend on framebuffer size and survives resize
+	GraphicsPipeline&	setDynamicViewport ()
+	{
+		return addDynamicState ( VK_DYNAMIC_STATE_VIEWPORT ).addDynamicState ( VK_DYNAMIC_STATE_SCISSOR );
+	}
+
+	bool	hasDynamicState ( VkDynamicState state ) const
+	{
+		return std::find ( dynamicStates.begin (), dynamicStates.end (), state ) != dynamicStates.end ();
+	}
+
+			// record full-size viewport and scissor for pipeline with dynamic viewport
+	void	setViewport ( VkCommandBuffer cmd, uint32_t w, uint32_t h ) const
+	{
+		VkViewport	viewport = { 0.0f, 0.0f, (float) w, (float) h, minDepth, maxDepth };
+		VkRect2D	scissor  = { { 0, 0 }, { w, h } };
+
+		vkCmdSetViewport ( cmd, 0, 1, &viewport );
+		vkCmdSetScissor  ( cmd, 0, 1, &scissor  );
+	}
+
+			// per-draw data (model matrix, material index) recorded into command buffer,
+			// offset and size must be multiples of 4
+	GraphicsPipeline&	addPushConstantRange ( VkShaderStageFlags stages, uint32_t offset, uint32_t size )
+	{
+		pushConstantRanges.push_back ( { stages, offset, size } );
+
+		return *this;
+	}
+
+	template <typename T>
+	void	pushConstants ( VkCommandBuffer cmd, VkShaderStageFlags stages, const T& data, uint32_t offset = 0 ) const
+	{
+		static_assert ( sizeof ( T ) % 4 == 0, "push constant size must be a multiple of 4" );
+
+		vkCmdPushConstants ( cmd, pipelineLayout, stages, offset, sizeof ( T ), &data );
+	}
+
 	GraphicsPipeline&	setDepthTest ( bool flag )
 	{
 		depthTestEnable = flag ? VK_TRUE : VK_FALSE;
@@ -804,6 +915,8 @@ public:
 	
 	void	create ( Renderpass& renderPass ) // XXX - VkRenderPass renderPass )
 	{
+		TraceScope	trace ( "GraphicsPipeline::create" );
+
 		if ( !device )
 			fatal () << "Pipeline: device is NULL" << Log::endl;
 		
@@ -867,6 +980,12 @@ public:
 		viewportState.scissorCount  = 1;
 		viewportState.pScissors     = &scissor;
 
+		VkPipelineDynamicStateCreateInfo	dynamicState = {};
+
+		dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = (uint32_t) dynamicStates.size ();
+		dynamicState.pDynamicStates    = dynamicStates.data ();
+
 		VkPipelineRasterizationStateCreateInfo rasterizer = {};
 
 		rasterizer.sType                   = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -956,13 +1075,18 @@ public:
 			
 			for ( auto& d : descLayouts )
 			{
-				d.create          ( device );
+				d.create          ( *owner );
 				layouts.push_back ( d.getHandle () );
 			}
 		
 			pipelineLayoutInfo.setLayoutCount = (uint32_t) layouts.size ();
 			pipelineLayoutInfo.pSetLayouts    = layouts.data ();
 		}
+
+		checkPushConstantRanges ( *owner, pushConstantRanges );
+
+		pipelineLayoutInfo.pushConstantRangeCount = (uint32_t) pushConstantRanges.size ();
+		pipelineLayoutInfo.pPushConstantRanges    = pushConstantRanges.empty () ? nullptr : pushConstantRanges.data ();
 		
 		if ( vkCreatePipelineLayout ( device, &pipelineLayoutInfo, nullptr, &pipelineLayout ) != VK_SUCCESS )
 			fatal () << "Pipeline: failed to create pipeline layout!";
@@ -979,12 +1103,16 @@ public:
 		pipelineInfo.pMultisampleState   = &multisampling;
 		pipelineInfo.pDepthStencilState  = &depthStencil;
 		pipelineInfo.pColorBlendState    = &colorBlending;
+		pipelineInfo.pDynamicState       = dynamicStates.empty () ? nullptr : &dynamicState;
 		pipelineInfo.layout              = pipelineLayout;
 		pipelineInfo.renderPass          = renderPass.getHandle ();
 		pipelineInfo.subpass             = 0;
 		pipelineInfo.basePipelineHandle  = VK_NULL_HANDLE;
 
-		if ( vkCreateGraphicsPipelines ( device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline ) != VK_SUCCESS )
+		VkResult	res = cache != nullptr ? cache->createPipeline ( pipelineInfo, &pipeline ) : 
+												 vkCreateGraphicsPipelines ( device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline );
+
+		if ( res != VK_SUCCESS )
 			fatal () << "Pipeline: failed to create graphics pipeline!";
 	}
 };
@@ -997,6 +1125,7 @@ class	ComputePipeline
 	
 	Shader				shader;
 	DescSetLayout		descLayout;
+	std::vector<VkPushConstantRange>	pushConstantRanges;
 	
 public:
 	ComputePipeline  () = default;
@@ -1018,6 +1147,8 @@ public:
 		
 		shader.clean     ();
 		descLayout.clean ();
+
+		pushConstantRanges.clear ();
 	}
 	
 	VkPipeline	getHandle () const
@@ -1044,12 +1175,7 @@ public:
 	
 	ComputePipeline&	setShader ( const std::string& fileName ) 
 	{
-		Data	data ( fileName );
-		
-		if ( data.getLength () < 1 )
-			fatal () << "Shader: cannot open " << fileName << Log::endl;
-		
-		shader.load ( device->getDevice (), data );
+		shader.load ( *device, fileName );
 		
 		return *this; 
 	}
@@ -1061,28 +1187,52 @@ public:
 		return *this;
 	}
 
+			// per-dispatch parameters recorded into command buffer, offset and size must be multiples of 4
+	ComputePipeline&	addPushConstantRange ( VkShaderStageFlags stages, uint32_t offset, uint32_t size )
+	{
+		pushConstantRanges.push_back ( { stages, offset, size } );
+
+		return *this;
+	}
+
+	template <typename T>
+	void	pushConstants ( VkCommandBuffer cmd, VkShaderStageFlags stages, const T& data, uint32_t offset = 0 ) const
+	{
+		static_assert ( sizeof ( T ) % 4 == 0, "push constant size must be a multiple of 4" );
+
+		vkCmdPushConstants ( cmd, pipelineLayout, stages, offset, sizeof ( T ), &data );
+	}
+
 	ComputePipeline&	create ()
 	{
+		TraceScope	trace ( "ComputePipeline::create" );
+
 		if ( !device )
 			fatal () << "Pipeline: device is NULL" << Log::endl;
 		
 		VkComputePipelineCreateInfo		pipelineInfo       = {};
 		VkPipelineShaderStageCreateInfo stageInfo          = {};	
 		VkPipelineLayoutCreateInfo		pipelineLayoutInfo = {};
+		VkDescriptorSetLayout			descriptorSetLayout = VK_NULL_HANDLE;		// must live till layout is created
 		
 		pipelineLayoutInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = 0;
 		
 		if ( descLayout.count () > 0 )
 		{
-			descLayout.create ( device->getDevice () );
+			descLayout.create ( *device );
 			
-			VkDescriptorSetLayout	descriptorSetLayout = descLayout.getHandle ();
+			descriptorSetLayout = descLayout.getHandle ();
 			
 			pipelineLayoutInfo.setLayoutCount = 1;
 			pipelineLayoutInfo.pSetLayouts    = &descriptorSetLayout;
 		}
 
+		checkPushConstantRanges ( *device, pushConstantRanges );
+
+		pipelineLayoutInfo.pushConstantRangeCount = (uint32_t) pushConstantRanges.size ();
+		pipelineLayoutInfo.pPushConstantRanges    = pushConstantRanges.empty () ? nullptr : pushConstantRanges.data ();
+
 		if ( vkCreatePipelineLayout ( device->getDevice (), &pipelineLayoutInfo, nullptr, &pipelineLayout ) != VK_SUCCESS )
 			fatal () << "Pipeline: failed to create pipeline layout!";
 
@@ -1095,7 +1245,11 @@ public:
 		pipelineInfo.stage  = stageInfo;
 		pipelineInfo.layout = pipelineLayout;
 		
-		if ( vkCreateComputePipelines ( device->getDevice (), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline ) != VK_SUCCESS )
+		PipelineCache * cache = device->getPipelineCache ();
+		VkResult		res   = cache != nullptr ? cache->createPipeline ( pipelineInfo, &pipeline ) : 
+												   vkCreateComputePipelines ( device->getDevice (), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline );
+
+		if ( res != VK_SUCCESS )
 			fatal () << "Pipeline: failed to create compute pipeline!";
 
 		return *this;
@@ -0,0 +1,75 @@
+//
+// Creates several pipelines concurrently.
+// Pipelines are set up as usual but instead of calling create they are added
+// to the batch, create compiles them on worker threads and returns when all
+// of them are ready. Pipelines share device pipeline cache, which is thread-safe
+//
+
+#pragma once
+
+#include	<algorithm>
+#include	<atomic>
+#include	<functional>
+#include	<thread>
+#include	<vector>
+#include	"Pipeline.h"
+#include	"Trace.h"
+
+class	PipelineBatch
+{
+	std::vector<std::function<void ()>>	jobs;
+	uint32_t							threadCount = 0;		// 0 - all hardware threads
+
+public:
+	PipelineBatch () = default;
+
+			// calling thread is one of them
+	PipelineBatch&	setThreadCount ( uint32_t count )
+	{
+		threadCount = count;
+
+		return *this;
+	}
+
+			// pipeline and render pass must stay alive till create
+	PipelineBatch&	add ( GraphicsPipeline& pipeline, Renderpass& renderPass )
+	{
+		jobs.push_back ( [&pipeline, &renderPass] { pipeline.create ( renderPass ); } );
+
+		return *this;
+	}
+
+	PipelineBatch&	add ( ComputePipeline& pipeline )
+	{
+		jobs.push_back ( [&pipeline] { pipeline.create (); } );
+
+		return *this;
+	}
+
+			// create all added pipelines, batch is empty afterwards
+	void	create ()
+	{
+		TraceScope				trace ( "PipelineBatch::create" );
+		std::atomic<size_t>		next ( 0 );
+		std::vector<std::thread>	threads;
+		uint32_t				count = threadCount > 0 ? threadCount : std::max ( 1u, std::thread::hardware_concurrency () );
+
+		auto	worker = [this, &next] ()
+		{
+			for ( size_t i = next++; i < jobs.size (); i = next++ )
+				jobs [i] ();
+		};
+
+		count = std::min ( count, (uint32_t) jobs.size () );
+
+		for ( uint32_t i = 1; i < count; i++ )
+			threads.emplace_back ( worker );
+
+		worker ();
+
+		for ( auto& t : threads )
+			t.join ();
+
+		jobs.clear ();
+	}
+};
@@ -0,0 +1,230 @@
+//
+// Device-wide VkPipelineCache kept on disk between runs.
+// Saved data is used only when its header matches vendor, device and
+// pipelineCacheUUID of current device, otherwise cache starts empty.
+// Counts pipelines created through it, time spent and (with
+// VK_EXT_pipeline_creation_feedback) how many of them were cache hits
+//
+
+#pragma once
+
+#include	<atomic>
+#include	<chrono>
+#include	<string>
+#include	<vector>
+#include	<stdio.h>
+#include	<string.h>
+#include	"Log.h"
+#include	"Data.h"
+#include	"Device.h"
+
+struct	PipelineCacheStats
+{
+	uint32_t	created  = 0;			// pipelines created through cache
+	uint32_t	hits     = 0;			// of them found in cache, valid if feedback is set
+	double		totalMs  = 0;			// time spent in vkCreate*Pipelines
+	double		maxMs    = 0;
+	bool		feedback = false;		// driver reports cache hits
+	size_t		loadedBytes = 0;		// size of data loaded from disk, 0 - started empty
+};
+
+class	PipelineCache
+{
+	Device				  * device   = nullptr;
+	VkPipelineCache			cache    = VK_NULL_HANDLE;
+	std::string				fileName;					// empty - cache is not kept on disk
+	bool					feedback = false;
+	size_t					loadedBytes = 0;
+	std::atomic<uint32_t>	created  { 0 };				// pipelines may be created from several threads
+	std::atomic<uint32_t>	hits     { 0 };
+	std::atomic<uint64_t>	totalUs  { 0 };
+	std::atomic<uint64_t>	maxUs    { 0 };
+
+public:
+			// withFeedback - VK_EXT_pipeline_creation_feedback is enabled on device
+	PipelineCache ( Device& dev, const std::string& file, bool withFeedback ) : device ( &dev ), fileName ( file ), feedback ( withFeedback )
+	{
+		std::vector<uint8_t>		initial;
+		VkPipelineCacheCreateInfo	info = {};
+
+		if ( !fileName.empty () )
+			load ( initial );
+
+		info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		info.initialDataSize = initial.size ();
+		info.pInitialData    = initial.empty () ? nullptr : initial.data ();
+
+		if ( vkCreatePipelineCache ( device->getDevice (), &info, nullptr, &cache ) != VK_SUCCESS )
+			fatal () << "PipelineCache: failed to create pipeline cache" << Log::endl;
+
+		loadedBytes = initial.size ();
+	}
+
+	~PipelineCache ()
+	{
+		vkDestroyPipelineCache ( device->getDevice (), cache, nullptr );
+	}
+
+	VkPipelineCache	getHandle () const
+	{
+		return cache;
+	}
+
+	PipelineCacheStats	getStats () const
+	{
+		PipelineCacheStats	s;
+
+		s.created     = created;
+		s.hits        = hits;
+		s.totalMs     = totalUs * 0.001;
+		s.maxMs       = maxUs   * 0.001;
+		s.feedback    = feedback;
+		s.loadedBytes = loadedBytes;
+
+		return s;
+	}
+
+	void	report () const
+	{
+		PipelineCacheStats	s = getStats ();
+
+		log () << "PipelineCache: " << s.created << " pipelines, " << s.totalMs << " ms total, " << s.maxMs << " ms max, ";
+
+		if ( s.feedback )
+			log () << s.hits << " cache hits" << Log::endl;
+		else
+			log () << "hits not reported by driver" << Log::endl;
+	}
+
+			// write cache contents to file, done on exit
+	bool	save () const
+	{
+		if ( fileName.empty () )
+			return false;
+
+		size_t	size = 0;
+
+		if ( vkGetPipelineCacheData ( device->getDevice (), cache, &size, nullptr ) != VK_SUCCESS || size == 0 )
+			return false;
+
+		std::vector<uint8_t>	data ( size );
+
+		if ( vkGetPipelineCacheData ( device->getDevice (), cache, &size, data.data () ) != VK_SUCCESS )
+			return false;
+
+		FILE * fp = fopen ( fileName.c_str (), "wb" );
+
+		if ( fp == nullptr )
+		{
+			log () << "PipelineCache: cannot write " << fileName << Log::endl;
+
+			return false;
+		}
+
+		bool	ok = fwrite ( data.data (), 1, size, fp ) == size;
+
+		fclose ( fp );
+
+		return ok;
+	}
+
+	VkResult	createPipeline ( const VkGraphicsPipelineCreateInfo& info, VkPipeline * pipeline )
+	{
+		VkGraphicsPipelineCreateInfo	ci = info;
+
+		return timed ( ci, [&] { return vkCreateGraphicsPipelines ( device->getDevice (), cache, 1, &ci, nullptr, pipeline ); } );
+	}
+
+	VkResult	createPipeline ( const VkComputePipelineCreateInfo& info, VkPipeline * pipeline )
+	{
+		VkComputePipelineCreateInfo	ci = info;
+
+		return timed ( ci, [&] { return vkCreateComputePipelines ( device->getDevice (), cache, 1, &ci, nullptr, pipeline ); } );
+	}
+
+private:
+			// read file and check its header against current device
+	void	load ( std::vector<uint8_t>& initial )
+	{
+		Data	data ( fileName );
+
+		if ( !data.isOk () || data.getLength () <= 0 )
+			return;
+
+		const uint8_t * ptr = (const uint8_t *) data.getPtr ();
+		uint32_t		header [4];
+		uint8_t			uuid   [VK_UUID_SIZE];
+
+		if ( data.getLength () < (int)(sizeof ( header ) + VK_UUID_SIZE) )
+			return;
+
+		memcpy ( header, ptr,                    sizeof ( header ) );
+		memcpy ( uuid,   ptr + sizeof ( header ), VK_UUID_SIZE      );
+
+		const VkPhysicalDeviceProperties&	props = device->getProperties ();
+
+		if ( header [1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header [2] != props.vendorID || header [3] != props.deviceID ||
+			 memcmp ( uuid, props.pipelineCacheUUID, VK_UUID_SIZE ) != 0 )
+		{
+			log () << "PipelineCache: " << fileName << " was made by another device or driver, ignored" << Log::endl;
+
+			return;
+		}
+
+		initial.assign ( ptr, ptr + data.getLength () );
+
+		log () << "PipelineCache: loaded " << initial.size () << " bytes from " << fileName << Log::endl;
+	}
+
+	template <typename CreateInfo, typename Func>
+	VkResult	timed ( CreateInfo& ci, Func create )
+	{
+#ifdef	VK_EXT_pipeline_creation_feedback
+		VkPipelineCreationFeedbackEXT				pipelineFeedback = {};
+		std::vector<VkPipelineCreationFeedbackEXT>	stageFeedback ( stageCount ( ci ) );
+		VkPipelineCreationFeedbackCreateInfoEXT		feedbackInfo     = {};
+
+		if ( feedback )
+		{
+			feedbackInfo.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+			feedbackInfo.pNext                              = ci.pNext;
+			feedbackInfo.pPipelineCreationFeedback          = &pipelineFeedback;
+			feedbackInfo.pipelineStageCreationFeedbackCount = (uint32_t) stageFeedback.size ();
+			feedbackInfo.pPipelineStageCreationFeedbacks    = stageFeedback.data ();
+			ci.pNext                                        = &feedbackInfo;
+		}
+#endif
+
+		auto		start = std::chrono::steady_clock::now ();
+		VkResult	res   = create ();
+		uint64_t	us    = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now () - start ).count ();
+		uint64_t	prev  = maxUs;
+
+		if ( res != VK_SUCCESS )
+			return res;
+
+		created++;
+		totalUs += us;
+
+		while ( us > prev && !maxUs.compare_exchange_weak ( prev, us ) )
+			;
+
+#ifdef	VK_EXT_pipeline_creation_feedback
+		if ( feedback && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) &&
+			 (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) )
+			hits++;
+#endif
+
+		return res;
+	}
+
+	static uint32_t	stageCount ( const VkGraphicsPipelineCreateInfo& ci )
+	{
+		return ci.stageCount;
+	}
+
+	static uint32_t	stageCount ( const VkComputePipelineCreateInfo& )
+	{
+		return 1;
+	}
+};
@@ -6,6 +6,7 @@
 #pragma once
 
 #include	"Buffer.h"
+#include	"UploadManager.h"
 
 class	ScreenQuad
 {
@@ -48,13 +49,9 @@ public:
 		};
 
 		uint32_t			size = sizeof ( vertices );
-		Buffer				stagingBuffer;
-		SingleTimeCommand	cmd ( device );
-
-					// use staging buffer to copy data to GPU-local memory
-		stagingBuffer.create ( device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-		stagingBuffer.copy   ( vertices, size );
-		buffer.create        ( device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-		buffer.copyBuffer    ( cmd, stagingBuffer, size );
+
+					// use staging ring to copy data to GPU-local memory
+		buffer.create ( device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		device.getUploader ()->uploadBuffer ( buffer, vertices, size );
 	}
 };
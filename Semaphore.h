@@ -46,8 +46,8 @@ public:
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores    = &handle;
 		
-		vkQueueSubmit   ( queue, 1, &submitInfo, VK_NULL_HANDLE );
-		vkQueueWaitIdle ( queue );
+		device->submit   ( queue, 1, &submitInfo, VK_NULL_HANDLE );
+		device->waitIdle ( queue );
 	}
 };
 
@@ -0,0 +1,214 @@
+//
+// Device-wide cache of shader modules.
+// Modules are keyed by SPIR-V content hash, file path remembers hash together
+// with file size and modification time, so unchanged files are not read again.
+// Modules stay alive while referenced and are kept when unused, so pipelines
+// rebuilt on resize get them back at once, trim destroys unused ones
+//
+
+#pragma once
+
+#include	<chrono>
+#include	<map>
+#include	<mutex>
+#include	<string>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	"Log.h"
+#include	"Data.h"
+#include	"Device.h"
+
+struct	ShaderCacheStats
+{
+	uint32_t	requests = 0;			// modules asked for
+	uint32_t	hits     = 0;			// of them found in cache
+	uint32_t	reads    = 0;			// files read
+	uint32_t	created  = 0;			// modules created
+	uint32_t	live     = 0;			// modules in cache now
+	double		readMs   = 0;			// time spent reading files
+	double		createMs = 0;			// time spent in vkCreateShaderModule
+};
+
+class	ShaderCache
+{
+	struct	Module
+	{
+		VkShaderModule	module   = VK_NULL_HANDLE;
+		uint32_t		refCount = 0;
+	};
+
+	struct	FileInfo
+	{
+		uint64_t	hash  = 0;
+		int64_t		size  = 0;
+		int64_t		mtime = 0;
+	};
+
+	Device						  * device = nullptr;
+	std::map<uint64_t, Module>		modules;				// by content hash
+	std::map<VkShaderModule, uint64_t>	hashes;			// hash of every module
+	std::map<std::string, FileInfo>	files;					// by path
+	ShaderCacheStats				stats;
+	std::mutex						mutex;
+
+public:
+	explicit ShaderCache ( Device& dev ) : device ( &dev ) {}
+	~ShaderCache ()
+	{
+		for ( auto& m : modules )
+			vkDestroyShaderModule ( device->getDevice (), m.second.module, nullptr );
+	}
+
+	ShaderCacheStats	getStats ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		stats.live = (uint32_t) modules.size ();
+
+		return stats;
+	}
+
+	void	report ()
+	{
+		ShaderCacheStats	s = getStats ();
+
+		log () << "ShaderCache: " << s.requests << " requests, " << s.hits << " hits, " << s.reads << " files read in " << s.readMs << " ms, "
+			   << s.created << " modules created in " << s.createMs << " ms" << Log::endl;
+	}
+
+			// module for SPIR-V file, reference must be released with release,
+			// VK_NULL_HANDLE if file cannot be read
+	VkShaderModule	acquire ( const std::string& fileName )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+		int64_t						size, mtime;
+
+		stats.requests++;
+
+		if ( !fileStat ( fileName, size, mtime ) )
+			return VK_NULL_HANDLE;
+
+				// file did not change since it was read - skip reading it
+		auto	fit = files.find ( fileName );
+
+		if ( fit != files.end () && fit->second.size == size && fit->second.mtime == mtime )
+		{
+			auto	mit = modules.find ( fit->second.hash );
+
+			if ( mit != modules.end () )
+			{
+				stats.hits++;
+				mit->second.refCount++;
+
+				return mit->second.module;
+			}
+		}
+
+		auto	start = std::chrono::steady_clock::now ();
+		Data	data ( fileName );
+
+		stats.reads++;
+		stats.readMs += ms ( start );
+
+		if ( !data.isOk () || data.getLength () < 1 )
+			return VK_NULL_HANDLE;
+
+		uint64_t	hash = contentHash ( data );
+
+		files [fileName] = { hash, size, mtime };
+
+				// same code may come from another file or from changed one reverted back
+		auto	mit = modules.find ( hash );
+
+		if ( mit != modules.end () )
+		{
+			stats.hits++;
+			mit->second.refCount++;
+
+			return mit->second.module;
+		}
+
+		VkShaderModuleCreateInfo	createInfo = {};
+		Module						m;
+
+		createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = data.getLength ();
+		createInfo.pCode    = reinterpret_cast<const uint32_t*>( data.getPtr () );
+		start               = std::chrono::steady_clock::now ();
+
+		if ( vkCreateShaderModule ( device->getDevice (), &createInfo, nullptr, &m.module ) != VK_SUCCESS )
+			fatal () << "ShaderCache: failed to create shader module for " << fileName << Log::endl;
+
+		stats.created++;
+		stats.createMs += ms ( start );
+
+		m.refCount       = 1;
+		modules [hash]   = m;
+		hashes [m.module] = hash;
+
+		return m.module;
+	}
+
+			// module is kept in cache when no longer referenced
+	void	release ( VkShaderModule module )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+		auto						it = hashes.find ( module );
+
+		if ( it == hashes.end () )
+			return;
+
+		Module&	m = modules [it->second];
+
+		if ( m.refCount > 0 )
+			m.refCount--;
+	}
+
+			// destroy modules nobody references
+	void	trim ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		for ( auto it = modules.begin (); it != modules.end (); )
+			if ( it->second.refCount == 0 )
+			{
+				vkDestroyShaderModule ( device->getDevice (), it->second.module, nullptr );
+				hashes.erase          ( it->second.module );
+
+				it = modules.erase ( it );
+			}
+			else
+				++it;
+	}
+
+private:
+	static bool	fileStat ( const std::string& fileName, int64_t& size, int64_t& mtime )
+	{
+		struct stat	st;
+
+		if ( stat ( fileName.c_str (), &st ) != 0 )
+			return false;
+
+		size  = (int64_t) st.st_size;
+		mtime = (int64_t) st.st_mtime;
+
+		return true;
+	}
+
+			// FNV-1a over SPIR-V code
+	static uint64_t	contentHash ( const Data& data )
+	{
+		const uint8_t * p    = (const uint8_t *) data.getPtr ();
+		uint64_t		hash = 14695981039346656037ull;
+
+		for ( int i = 0; i < data.getLength (); i++ )
+			hash = (hash ^ p [i]) * 1099511628211ull;
+
+		return hash;
+	}
+
+	static double	ms ( std::chrono::steady_clock::time_point start )
+	{
+		return std::chrono::duration<double, std::milli> ( std::chrono::steady_clock::now () - start ).count ();
+	}
+};
@@ -1,39 +1,267 @@
-
 #pragma once
+
+#include	<deque>
+#include	<vector>
+#include	<map>
+#include	<mutex>
+#include	<thread>
+#include	"Log.h"
 #include	"Device.h"
 
+class	OneTimeCommandPool;
+
+		// completion handle of submitted one-time command
+class	CommandHandle
+{
+	OneTimeCommandPool * pool   = nullptr;
+	uint64_t			 serial = 0;
+
+public:
+	CommandHandle () = default;
+	CommandHandle ( OneTimeCommandPool * p, uint64_t s ) : pool ( p ), serial ( s ) {}
+
+	uint64_t	getSerial () const
+	{
+		return serial;
+	}
+
+	OneTimeCommandPool * getPool () const
+	{
+		return pool;
+	}
+
+			// empty handle is always done
+	inline bool	isDone () const;
+	inline void	wait   () const;
+};
+
+		// per-thread pool of one-time command buffers for graphics queue,
+		// command buffers and fences are recycled when their commands complete
+class	OneTimeCommandPool
+{
+public:
+	struct	Entry
+	{
+		VkCommandBuffer	cmd    = VK_NULL_HANDLE;
+		VkFence			fence  = VK_NULL_HANDLE;
+		uint64_t		serial = 0;
+	};
+
+private:
+	typedef std::map<std::pair<Device *, std::thread::id>, OneTimeCommandPool *>	Registry;
+
+	Device			  * device     = nullptr;
+	VkCommandPool		pool       = VK_NULL_HANDLE;
+	VkQueue				queue      = VK_NULL_HANDLE;
+	std::deque<Entry>	inFlight;					// in submission order
+	std::vector<Entry>	freeList;
+	uint64_t			nextSerial = 1;
+	uint64_t			completed  = 0;				// all serials up to this are done
+	std::mutex			mutex;						// handles may be polled from other threads
+
+	static std::mutex&	registryMutex ()
+	{
+		static std::mutex	m;
+
+		return m;
+	}
+
+	static Registry&	registry ()
+	{
+		static Registry	r;
+
+		return r;
+	}
+
+public:
+	OneTimeCommandPool ( Device& dev ) : device ( &dev ), queue ( dev.getGraphicsQueue () )
+	{
+		VkCommandPoolCreateInfo	poolInfo = {};
+
+		poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = dev.getGraphicsFamilyIndex ();
+		poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if ( vkCreateCommandPool ( device->getDevice (), &poolInfo, nullptr, &pool ) != VK_SUCCESS )
+			fatal () << "OneTimeCommandPool: failed to create command pool!" << Log::endl;
+	}
+
+	~OneTimeCommandPool ()
+	{
+		wait ( nextSerial - 1 );
+
+		for ( auto& e : freeList )
+			vkDestroyFence ( device->getDevice (), e.fence, nullptr );
+
+		vkDestroyCommandPool ( device->getDevice (), pool, nullptr );
+	}
+
+			// pool for calling thread, created on first use
+	static OneTimeCommandPool&	forThread ( Device& dev )
+	{
+		std::lock_guard<std::mutex>	lock ( registryMutex () );
+		auto&						p = registry () [std::make_pair ( &dev, std::this_thread::get_id () )];
+
+		if ( p == nullptr )
+			p = new OneTimeCommandPool ( dev );
+
+		return *p;
+	}
+
+			// wait for and destroy pools of all threads, must be called before device is destroyed
+	static void	releaseAll ( Device& dev )
+	{
+		std::lock_guard<std::mutex>	lock ( registryMutex () );
+		Registry&					r = registry ();
+
+		for ( auto it = r.begin (); it != r.end (); )
+			if ( it->first.first == &dev )
+			{
+				delete it->second;
+				it = r.erase ( it );
+			}
+			else
+				++it;
+	}
+
+			// get command buffer in recording state
+	Entry	begin ()
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+		VkCommandBufferBeginInfo	beginInfo = {};
+		Entry						entry;
+
+		poll ();
+
+		if ( !freeList.empty () )
+		{
+			entry = freeList.back ();
+			freeList.pop_back ();
+			vkResetCommandBuffer ( entry.cmd, 0 );
+		}
+		else
+		{
+			VkCommandBufferAllocateInfo	allocInfo = {};
+			VkFenceCreateInfo			fenceInfo = {};
+
+			allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool        = pool;
+			allocInfo.commandBufferCount = 1;
+			fenceInfo.sType              = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+			if ( vkAllocateCommandBuffers ( device->getDevice (), &allocInfo, &entry.cmd ) != VK_SUCCESS )
+				fatal () << "OneTimeCommandPool: failed to allocate command buffer!" << Log::endl;
+
+			vkCreateFence ( device->getDevice (), &fenceInfo, nullptr, &entry.fence );
+		}
+
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer ( entry.cmd, &beginInfo );
+
+		return entry;
+	}
+
+	CommandHandle	submit ( Entry& entry )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+		VkSubmitInfo				submitInfo = {};
+
+		vkEndCommandBuffer ( entry.cmd );
+
+		submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers    = &entry.cmd;
+
+		if ( device->submit ( queue, 1, &submitInfo, entry.fence ) != VK_SUCCESS )
+			fatal () << "OneTimeCommandPool: failed to submit command buffer!" << Log::endl;
+
+		entry.serial = nextSerial++;
+
+		inFlight.push_back ( entry );
+
+		return CommandHandle ( this, entry.serial );
+	}
+
+	bool	isComplete ( uint64_t serial )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		poll ();
+
+		return serial <= completed;
+	}
+
+	void	wait ( uint64_t serial )
+	{
+		std::lock_guard<std::mutex>	lock ( mutex );
+
+		while ( completed < serial && !inFlight.empty () )
+		{
+			vkWaitForFences ( device->getDevice (), 1, &inFlight.front ().fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT );
+			retire ();
+		}
+	}
+
+private:
+	void	poll ()
+	{
+		while ( !inFlight.empty () && vkGetFenceStatus ( device->getDevice (), inFlight.front ().fence ) == VK_SUCCESS )
+			retire ();
+	}
+
+	void	retire ()
+	{
+		Entry	entry = inFlight.front ();
+
+		inFlight.pop_front ();
+		vkResetFences ( device->getDevice (), 1, &entry.fence );
+
+		completed = entry.serial;
+
+		freeList.push_back ( entry );
+	}
+};
+
+inline bool	CommandHandle::isDone () const
+{
+	return pool == nullptr || pool->isComplete ( serial );
+}
+
+inline void	CommandHandle::wait () const
+{
+	if ( pool != nullptr )
+		pool->wait ( serial );
+}
+
+		// one-off command buffer, submitted on destruction or by explicit submit ()
+		// with sync = false destructor does not wait, use handle returned by submit () to track it
 class	SingleTimeCommand
 {
 	Device			  * device = nullptr;
 	bool			syncOnExit = false;
 	VkQueue			queue;
-	VkCommandPool		commandPool;
+	VkCommandPool		commandPool   = VK_NULL_HANDLE;		// only when given explicitly
 	VkCommandBuffer		commandBuffer = VK_NULL_HANDLE;
+	OneTimeCommandPool		  * recycler      = nullptr;		// per-thread pool we got buffer from
+	OneTimeCommandPool::Entry	entry;
+	CommandHandle		handle;
+	bool				submitted = false;
 
 public:
-	SingleTimeCommand ( Device& dev, bool sync = true ) : device ( &dev ), queue ( dev.getGraphicsQueue () ), commandPool ( dev.getCommandPool () ), syncOnExit ( sync )
+	SingleTimeCommand ( Device& dev, bool sync = true ) : device ( &dev ), queue ( dev.getGraphicsQueue () ), syncOnExit ( sync )
 	{
 		assert ( dev.getDevice () != VK_NULL_HANDLE );
-		assert ( commandPool != VK_NULL_HANDLE );
 		assert ( queue != VK_NULL_HANDLE );
 
-		VkCommandBufferAllocateInfo	allocInfo = {};
-		VkCommandBufferBeginInfo	beginInfo = {};
-	
-		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool        = commandPool;
-		allocInfo.commandBufferCount = 1;
-
-		vkAllocateCommandBuffers ( device->getDevice (), &allocInfo, &commandBuffer );
-
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		vkBeginCommandBuffer ( commandBuffer, &beginInfo );
+		recycler      = &OneTimeCommandPool::forThread ( dev );
+		entry         = recycler->begin ();
+		commandBuffer = entry.cmd;
 	}
 
-	SingleTimeCommand ( Device& dev, VkQueue q, VkCommandPool pool ) : device ( &dev ), queue ( q ), commandPool ( pool )
+	SingleTimeCommand ( Device& dev, VkQueue q, VkCommandPool pool ) : device ( &dev ), queue ( q ), commandPool ( pool ), syncOnExit ( true )
 	{
 		assert ( dev.getDevice () != VK_NULL_HANDLE );
 		assert ( commandPool != VK_NULL_HANDLE );
@@ -41,7 +269,7 @@ public:
 
 		VkCommandBufferAllocateInfo	allocInfo = {};
 		VkCommandBufferBeginInfo	beginInfo = {};
-	
+
 		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 		allocInfo.commandPool        = commandPool;
@@ -57,47 +285,68 @@ public:
 
 	~SingleTimeCommand ()
 	{
-		assert ( device->getDevice () != VK_NULL_HANDLE );
-		assert ( commandPool != VK_NULL_HANDLE );
-		assert ( queue != VK_NULL_HANDLE );
-		assert ( commandBuffer != VK_NULL_HANDLE );
+		if ( !submitted )
+			submit ();
 
-		vkEndCommandBuffer ( commandBuffer );
+		if ( syncOnExit )
+			handle.wait ();
+	}
 
-		VkSubmitInfo submitInfo = {};
-	
-		submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers    = &commandBuffer;
+	VkCommandBuffer	getHandle () const
+	{
+		return commandBuffer;
+	}
 
-		VkFence fence               = VK_NULL_HANDLE;
+			// make this command see results of previously submitted one,
+			// call before recording anything else
+	SingleTimeCommand&	after ( const CommandHandle& prev )
+	{
+		if ( prev.getPool () == nullptr )
+			return *this;
 
-		if ( syncOnExit )
-		{
-			VkFenceCreateInfo fenceInfo = {};
+		VkMemoryBarrier	barrier = {};
 
-			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+				// both go to the same queue, so submission order plus barrier is enough
+		barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
 
-			vkCreateFence ( device->getDevice (), &fenceInfo, nullptr, &fence );
-		}
+		vkCmdPipelineBarrier ( commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+
+		return *this;
+	}
 
-			// Submit to the queue
-		vkQueueSubmit ( queue, 1, &submitInfo, fence );
+			// submit without waiting, command buffer must not be used after it
+	CommandHandle	submit ()
+	{
+		assert ( !submitted );
+		assert ( commandBuffer != VK_NULL_HANDLE );
 
-			// Wait for the fence to signal that command buffer has finished executing
-		if ( syncOnExit )
-		{
-			vkWaitForFences ( device->getDevice (), 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT );
-			vkDestroyFence  ( device->getDevice (), fence, nullptr );
-		}
+		submitted = true;
+
+		if ( recycler != nullptr )
+			return handle = recycler->submit ( entry );
+
+				// explicit pool - we cannot recycle buffer later, so wait for it here
+		VkSubmitInfo		submitInfo = {};
+		VkFenceCreateInfo	fenceInfo  = {};
+		VkFence				fence      = VK_NULL_HANDLE;
+
+		vkEndCommandBuffer ( commandBuffer );
 
-//		vkQueueSubmit        ( queue, 1, &submitInfo, VK_NULL_HANDLE );
-		vkQueueWaitIdle      ( queue );
+		submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers    = &commandBuffer;
+		fenceInfo.sType               = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		vkCreateFence        ( device->getDevice (), &fenceInfo, nullptr, &fence );
+		device->submit       ( queue, 1, &submitInfo, fence );
+		vkWaitForFences      ( device->getDevice (), 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT );
+		vkDestroyFence       ( device->getDevice (), fence, nullptr );
 		vkFreeCommandBuffers ( device->getDevice (), commandPool, 1, &commandBuffer );
-	}
 
-	VkCommandBuffer	getHandle () const
-	{
-		return commandBuffer;
+		commandBuffer = VK_NULL_HANDLE;
+
+		return handle;
 	}
 };
@@ -1,6 +1,9 @@
 
+#include	<memory>
 #include	"Log.h"
 #include	"Device.h"
+#include	"DeletionQueue.h"
+#include	"Texture.h"
 
 
 struct SwapChainSupportDetails 
@@ -24,6 +27,9 @@ class	SwapChain
 	std::vector<VkFramebuffer>	swapChainFramebuffers;
 	VkFormat					swapChainImageFormat;
 	VkExtent2D					swapChainExtent;
+	bool						headless  = false;						// images below instead of surface
+	uint32_t					nextImage = 0;							// next headless image to acquire
+	std::vector<std::unique_ptr<Image>>	offscreenImages;
 
 					// sync objects
 	std::vector<VkSemaphore>	imageAvailableSemaphores;
@@ -32,10 +38,19 @@ class	SwapChain
 	std::vector<VkFence>		imagesInFlight;
 	size_t 						currentFrame = 0;
 
-	const int MAX_FRAMES_IN_FLIGHT = 2;
-
+					// settings, applied when swap chain (or sync objects) are (re)created
+	uint32_t					framesInFlight     = 2;
+	uint32_t					requestedImages    = 0;							// 0 - minImageCount + 1
+	VkPresentModeKHR			requestedMode      = VK_PRESENT_MODE_MAILBOX_KHR;
+	VkPresentModeKHR			presentMode        = VK_PRESENT_MODE_FIFO_KHR;	// mode we actually got
 
 public:
+	enum
+	{
+		maxFramesInFlight = 4
+	};
+
+
 	SwapChain () = default;
 	~SwapChain () = default;
 
@@ -53,6 +68,11 @@ public:
 	{
 		return (uint32_t) swapChainImages.size ();
 	}
+
+	bool	isHeadless () const
+	{
+		return headless;
+	}
 	
 	bool	presentSupport ( int queue ) const
 	{
@@ -87,20 +107,77 @@ public:
 	{
 		return inFlightFences [currentFrame];
 	}
+
+	uint32_t	getFramesInFlight () const
+	{
+		return framesInFlight;
+	}
+
+			// index of frame in flight being recorded, its fence was waited for by acquireNextImage
+	uint32_t	getCurrentFrame () const
+	{
+		return (uint32_t) currentFrame;
+	}
+
+			// takes effect on next createSyncObjects
+	SwapChain&	setFramesInFlight ( uint32_t count )
+	{
+		framesInFlight = std::max ( 1u, std::min ( count, (uint32_t) maxFramesInFlight ) );
+
+		return *this;
+	}
+
+			// FIFO is always available and is used when requested mode is not supported,
+			// takes effect on next createSwapChain
+	SwapChain&	setPresentMode ( VkPresentModeKHR mode )
+	{
+		requestedMode = mode;
+
+		return *this;
+	}
+
+			// 0 selects minImageCount + 1, count is clamped to surface limits on creation
+	SwapChain&	setImageCount ( uint32_t count )
+	{
+		requestedImages = count;
+
+		return *this;
+	}
+
+	VkPresentModeKHR	getRequestedPresentMode () const
+	{
+		return requestedMode;
+	}
+
+			// mode swap chain was actually created with
+	VkPresentModeKHR	getPresentMode () const
+	{
+		return presentMode;
+	}
+
+	static const char * presentModeName ( VkPresentModeKHR mode )
+	{
+		switch ( mode )
+		{
+			case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "immediate";
+			case VK_PRESENT_MODE_MAILBOX_KHR:      return "mailbox";
+			case VK_PRESENT_MODE_FIFO_KHR:         return "fifo";
+			case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+			default:                               return "unknown";
+		}
+	}
+
+			// wait till all submitted frames are done, other queues keep working
+	void	waitForFrames ()
+	{
+		if ( !inFlightFences.empty () )
+			vkWaitForFences ( device->getDevice (), (uint32_t) inFlightFences.size (), inFlightFences.data (), VK_TRUE, UINT64_MAX );
+	}
 	
 	void	cleanup ( bool cleanSync = true )
 	{
 		if ( cleanSync )
-			for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
-			{
-				vkDestroySemaphore ( device->getDevice (), renderFinishedSemaphores [i], nullptr );
-				vkDestroySemaphore ( device->getDevice (), imageAvailableSemaphores [i], nullptr );
-				vkDestroyFence     ( device->getDevice (), inFlightFences           [i], nullptr );
-				
-				renderFinishedSemaphores [i] = VK_NULL_HANDLE;
-				imageAvailableSemaphores [i] = VK_NULL_HANDLE;
-				inFlightFences           [i] = VK_NULL_HANDLE;
-			}
+			destroySyncObjects ();
 
 		for ( auto framebuffer : swapChainFramebuffers )
 			vkDestroyFramebuffer ( device->getDevice (), framebuffer, nullptr );
@@ -108,10 +185,12 @@ public:
 		for ( auto imageView : swapChainImageViews ) 
 			vkDestroyImageView ( device->getDevice (), imageView, nullptr );
 		
-		vkDestroySwapchainKHR ( device->getDevice (), swapChain, nullptr );
+		if ( swapChain != VK_NULL_HANDLE )
+			vkDestroySwapchainKHR ( device->getDevice (), swapChain, nullptr );
 
 		swapChainFramebuffers.clear ();
 		swapChainImageViews.clear   ();
+		offscreenImages.clear       ();
 
 		swapChain    = VK_NULL_HANDLE;
 		//currentFrame = 0;
@@ -126,12 +205,16 @@ public:
 		VkSurfaceCapabilitiesKHR surfCaps;
 		SwapChainSupportDetails	swapChainSupport = querySwapChainSupport   ();
 		VkSurfaceFormatKHR		surfaceFormat    = chooseSwapSurfaceFormat ( swapChainSupport.formats );
-		VkPresentModeKHR		presentMode      = chooseSwapPresentMode   ( swapChainSupport.presentModes );
 		VkExtent2D				extent           = chooseSwapExtent        ( swapChainSupport.capabilities, width, height );
 		uint32_t				imageCount       = swapChainSupport.capabilities.minImageCount + 1;
 
+		presentMode = chooseSwapPresentMode ( swapChainSupport.presentModes );
+
 		vkGetPhysicalDeviceSurfaceCapabilitiesKHR ( device->getPhysicalDevice (), surface, &surfCaps );
 
+		if ( requestedImages > 0 )
+			imageCount = std::max ( requestedImages, swapChainSupport.capabilities.minImageCount );
+
 		if ( swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount )
 			imageCount = swapChainSupport.capabilities.maxImageCount;
 
@@ -148,7 +231,7 @@ public:
 		createInfo.compositeAlpha   = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		createInfo.presentMode      = presentMode;
 		createInfo.clipped          = VK_TRUE;
-		createInfo.oldSwapchain     = VK_NULL_HANDLE;
+		createInfo.oldSwapchain     = swapChain;		// hand images over when resizing
 
 				// enable transfer source on swap chain images if supported
 		if ( surfCaps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT )
@@ -172,9 +255,16 @@ public:
 			createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 
-		if ( vkCreateSwapchainKHR ( device->getDevice (), &createInfo, nullptr, &swapChain ) != VK_SUCCESS )
+		VkSwapchainKHR	newSwapChain = VK_NULL_HANDLE;
+
+		if ( vkCreateSwapchainKHR ( device->getDevice (), &createInfo, nullptr, &newSwapChain ) != VK_SUCCESS )
 			fatal () << "SwapChain: failed to create swap chain!";
 
+				// old swap chain, its views and framebuffers go when frames using them retire
+		retireObjects ();
+
+		swapChain = newSwapChain;
+
 		vkGetSwapchainImagesKHR ( device->getDevice (), swapChain, &imageCount, nullptr );
 		swapChainImages.resize  ( imageCount );
 		vkGetSwapchainImagesKHR ( device->getDevice (), swapChain, &imageCount, swapChainImages.data () );
@@ -182,9 +272,54 @@ public:
 		swapChainImageFormat = surfaceFormat.format;
 		swapChainExtent      = extent;
 
+				// image count may differ from previous swap chain, old frames are done by now
+		imagesInFlight.assign ( imageCount, VK_NULL_HANDLE );
+
+		log () << "SwapChain: " << imageCount << " images, present mode " << presentModeName ( presentMode ) << ", " << framesInFlight << " frames in flight" << Log::endl;
+
 		createImageViews   ();
 	}
 
+			// ring of offscreen images used instead of swap chain, there is no surface or present,
+			// acquire and present only keep semaphores and fences working as with real swap chain
+	void createHeadless ( Device& dev, uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_B8G8R8A8_UNORM )
+	{
+		uint32_t	imageCount = requestedImages > 0 ? requestedImages : 3;
+
+		device               = &dev;
+		headless             = true;
+		nextImage            = 0;
+		presentMode          = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		swapChainImageFormat = format;
+		swapChainExtent      = { width, height };
+
+		retireObjects ();
+
+		for ( auto& image : offscreenImages )
+			image->deferredClean ();
+
+		swapChainImages.clear ();
+		offscreenImages.clear ();
+
+		for ( uint32_t i = 0; i < imageCount; i++ )
+		{
+			ImageCreateInfo	info ( width, height );
+
+			info.setFormat ( format )
+				.setUsage  ( VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT );
+
+			offscreenImages.emplace_back ( new Image );
+			offscreenImages.back ()->create ( dev, info );
+			swapChainImages.push_back ( offscreenImages.back ()->getHandle () );
+		}
+
+		imagesInFlight.assign ( imageCount, VK_NULL_HANDLE );
+
+		log () << "SwapChain: headless, " << imageCount << " images " << width << "x" << height << ", " << framesInFlight << " frames in flight" << Log::endl;
+
+		createImageViews ();
+	}
+
 	void createImageViews ()
 	{
 		swapChainImageViews.resize ( swapChainImages.size () );
@@ -236,10 +371,12 @@ public:
 
 	void createSyncObjects ()
 	{
-		imageAvailableSemaphores.resize ( MAX_FRAMES_IN_FLIGHT );
-		renderFinishedSemaphores.resize ( MAX_FRAMES_IN_FLIGHT );
-		inFlightFences.          resize ( MAX_FRAMES_IN_FLIGHT );
-		imagesInFlight.          resize ( swapChainImages.size (), VK_NULL_HANDLE );
+		imageAvailableSemaphores.resize ( framesInFlight );
+		renderFinishedSemaphores.resize ( framesInFlight );
+		inFlightFences.          resize ( framesInFlight );
+		imagesInFlight.assign ( swapChainImages.size (), VK_NULL_HANDLE );
+
+		currentFrame = 0;
 
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		VkFenceCreateInfo fenceInfo = {};
@@ -248,7 +385,7 @@ public:
 		fenceInfo.sType     = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags     = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for ( size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ )
+		for ( size_t i = 0; i < framesInFlight; i++ )
 		{
 			if ( vkCreateSemaphore ( device->getDevice (), &semaphoreInfo, nullptr, &imageAvailableSemaphores [i]) != VK_SUCCESS ||
 			     vkCreateSemaphore ( device->getDevice (), &semaphoreInfo, nullptr, &renderFinishedSemaphores [i]) != VK_SUCCESS ||
@@ -257,12 +394,69 @@ public:
 		}
 	}
 
+			// destroy swap chain, its views and framebuffers after frames using them are retired
+	void	retireObjects ()
+	{
+		if ( swapChain == VK_NULL_HANDLE && swapChainImageViews.empty () && swapChainFramebuffers.empty () )
+			return;
+
+		VkDevice					dev          = device->getDevice ();
+		VkSwapchainKHR				old          = swapChain;
+		std::vector<VkImageView>	views        = swapChainImageViews;
+		std::vector<VkFramebuffer>	framebuffers = swapChainFramebuffers;
+		auto						destroy      = [dev, old, views, framebuffers] ()
+		{
+			for ( auto framebuffer : framebuffers )
+				vkDestroyFramebuffer ( dev, framebuffer, nullptr );
+
+			for ( auto imageView : views ) 
+				vkDestroyImageView ( dev, imageView, nullptr );
+
+			if ( old != VK_NULL_HANDLE )
+				vkDestroySwapchainKHR ( dev, old, nullptr );
+		};
+
+		if ( device->getDeletionQueue () != nullptr )
+			device->getDeletionQueue ()->push ( destroy );
+		else
+			destroy ();
+
+		swapChainFramebuffers.clear ();
+		swapChainImageViews.clear   ();
+
+		swapChain = VK_NULL_HANDLE;
+	}
+
+			// all frames must be done, e.g. after waitForFrames ()
+	void	destroySyncObjects ()
+	{
+		for ( size_t i = 0; i < inFlightFences.size (); i++ )
+		{
+			vkDestroySemaphore ( device->getDevice (), renderFinishedSemaphores [i], nullptr );
+			vkDestroySemaphore ( device->getDevice (), imageAvailableSemaphores [i], nullptr );
+			vkDestroyFence     ( device->getDevice (), inFlightFences           [i], nullptr );
+		}
+
+		renderFinishedSemaphores.clear ();
+		imageAvailableSemaphores.clear ();
+		inFlightFences.clear           ();
+		imagesInFlight.assign ( imagesInFlight.size (), VK_NULL_HANDLE );
+	}
+
 	uint32_t	acquireNextImage ()
 	{
 		uint32_t	imageIndex;
 
 		vkWaitForFences ( device->getDevice (), 1, &inFlightFences [currentFrame], VK_TRUE, UINT64_MAX );
 
+		if ( headless )
+		{
+			imageIndex = nextImage;
+			nextImage  = (nextImage + 1) % imageCount ();
+
+			signalSemaphore ( imageAvailableSemaphores [currentFrame] );
+		}
+		else
 				// check for recreation
 		if ( vkAcquireNextImageKHR ( device->getDevice (), swapChain, UINT64_MAX, imageAvailableSemaphores [currentFrame], VK_NULL_HANDLE, &imageIndex ) ==  VK_ERROR_OUT_OF_DATE_KHR )
 			return UINT32_MAX;
@@ -275,8 +469,28 @@ public:
 		return imageIndex;
 	}
 
-	void	present ( uint32_t imageIndex, VkQueue presentQueue )
+			// returns false when swap chain is out of date or suboptimal and should be recreated
+	bool	present ( uint32_t imageIndex, VkQueue presentQueue )
 	{
+		if ( headless )
+		{
+				// consume render finished semaphore, so it can be signaled again
+			VkSubmitInfo			submitInfo = {};
+			VkPipelineStageFlags	waitStage  = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+			submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores    = &renderFinishedSemaphores [currentFrame];
+			submitInfo.pWaitDstStageMask  = &waitStage;
+
+			if ( device->submit ( presentQueue, 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
+				fatal () << "SwapChain: headless present failed" << Log::endl;
+
+			currentFrame = (currentFrame + 1) % framesInFlight;
+
+			return true;
+		}
+
 		VkPresentInfoKHR	presentInfo         = {};
 		VkSwapchainKHR		swapChains       [] = { swapChain };
 		VkSemaphore			signalSemaphores [] = { renderFinishedSemaphores [currentFrame] };
@@ -288,12 +502,27 @@ public:
 		presentInfo.pSwapchains        = swapChains;
 		presentInfo.pImageIndices      = &imageIndex;
 
-		vkQueuePresentKHR ( presentQueue, &presentInfo );
+		VkResult	result = device->present ( presentQueue, &presentInfo );
 
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		currentFrame = (currentFrame + 1) % framesInFlight;
+
+		return result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_SUBOPTIMAL_KHR;
 	}
 	
 private:
+			// headless acquire - image is available at once, signal semaphore samples wait for
+	void	signalSemaphore ( VkSemaphore semaphore )
+	{
+		VkSubmitInfo	submitInfo = {};
+
+		submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores    = &semaphore;
+
+		if ( device->submit ( device->getGraphicsQueue (), 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
+			fatal () << "SwapChain: headless acquire failed" << Log::endl;
+	}
+
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat ( const std::vector<VkSurfaceFormatKHR>& availableFormats )
 	{
 		for ( const auto& availableFormat : availableFormats )
@@ -306,7 +535,7 @@ private:
 	VkPresentModeKHR chooseSwapPresentMode ( const std::vector<VkPresentModeKHR>& availablePresentModes )
 	{
 		for ( const auto& availablePresentMode : availablePresentModes )
-			if ( availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR )
+			if ( availablePresentMode == requestedMode )
 				return availablePresentMode;
 
 		return VK_PRESENT_MODE_FIFO_KHR;
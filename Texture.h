@@ -3,8 +3,10 @@
 
 #include	"Buffer.h"
 #include	"SingleTimeCommand.h"
+#include	"UploadManager.h"
 #include	"Device.h"
 #include	"stb_image_aug.h"
+#include	"Trace.h"
 
 #include	<algorithm>			// for std::max
 #include	<cmath>				// for log2
@@ -114,6 +116,37 @@ public:
 		memory.clean ();
 	}
 
+			// destroy after frames that may still use image are retired
+	void	deferredClean ()
+	{
+		DeletionQueue * queue = memory.getDeletionQueue ();
+
+		if ( queue != nullptr && image != VK_NULL_HANDLE )
+		{
+			VkDevice	dev = memory.getDevice ();
+			VkImage		img = image;
+
+			queue->push ( [dev, img] () { vkDestroyImage ( dev, img, nullptr ); } );
+		}
+		else
+		if ( image != VK_NULL_HANDLE )
+			vkDestroyImage ( memory.getDevice (), image, nullptr );
+
+		image = VK_NULL_HANDLE;
+
+		memory.deferredClean ();
+	}
+
+	DeletionQueue * getDeletionQueue () const
+	{
+		return memory.getDeletionQueue ();
+	}
+
+	Device * getOwner () const
+	{
+		return memory.getOwner ();
+	}
+
 	uint32_t	getWidth () const
 	{
 		return width;
@@ -225,10 +258,10 @@ public:
 
 		vkGetImageMemoryRequirements ( dev.getDevice (), image, &memRequirements );
 
-		if ( !memory.alloc ( dev, memRequirements, properties ) )
+		if ( !memory.alloc ( dev, memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR ) )
 			fatal () << "Image: Cannot alloc memory for image";
 
-		vkBindImageMemory ( dev.getDevice (), image, memory.getMemory (), 0 );
+		vkBindImageMemory ( dev.getDevice (), image, memory.getMemory (), memory.getOffset () );
 
 		return true;
 	}
@@ -250,15 +283,20 @@ public:
 
 		vkGetImageMemoryRequirements ( dev.getDevice (), image, &memRequirements );
 
-		if ( !memory.alloc ( dev, memRequirements, properties ) )
+		if ( !memory.alloc ( dev, memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR ) )
 			fatal () << "Image: Cannot alloc memory for image";
 
-		vkBindImageMemory ( dev.getDevice (), image, memory.getMemory (), 0 );
+		vkBindImageMemory ( dev.getDevice (), image, memory.getMemory (), memory.getOffset () );
 
 		return true;
 	}
 	
 	void	transitionLayout ( SingleTimeCommand& cmd, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout )
+	{
+		transitionLayout ( cmd.getHandle (), format, oldLayout, newLayout );
+	}
+
+	void	transitionLayout ( VkCommandBuffer cmd, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout )
 	{
 		VkImageMemoryBarrier	barrier       = {};
 		VkPipelineStageFlags 	sourceStage;
@@ -319,7 +357,7 @@ public:
 			fatal () << "Texture: Unsupported layout transition!";
 
 		vkCmdPipelineBarrier (
-			cmd.getHandle (),
+			cmd,
 			sourceStage, destinationStage,
 			0,
 			0, nullptr,
@@ -328,10 +366,15 @@ public:
 	}
 
 	void	copyFromBuffer ( SingleTimeCommand& cmd, Buffer& buffer, uint32_t width, uint32_t height, uint32_t depth = 1, uint32_t layers = 1, uint32_t mipLevel = 0 )
+	{
+		copyFromBuffer ( cmd.getHandle (), buffer.getHandle (), 0, width, height, depth, layers, mipLevel );
+	}
+
+	void	copyFromBuffer ( VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, uint32_t width, uint32_t height, uint32_t depth = 1, uint32_t layers = 1, uint32_t mipLevel = 0 )
 	{
 		VkBufferImageCopy	region        = {};
 		
-		region.bufferOffset                    = 0;
+		region.bufferOffset                    = offset;
 		region.bufferRowLength                 = 0;
 		region.bufferImageHeight               = 0;
 		region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -341,7 +384,7 @@ public:
 		region.imageOffset                     = {0, 0, 0};
 		region.imageExtent                     = { width, height, depth };
 
-		vkCmdCopyBufferToImage ( cmd.getHandle (), buffer.getHandle (), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+		vkCmdCopyBufferToImage ( cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
 	}
 
 
@@ -354,6 +397,12 @@ public:
 	
 	static void	transitionLayout ( SingleTimeCommand& cmd, VkImage image, VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, 
 								   VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldLayout, VkImageLayout newLayout )
+	{
+		transitionLayout ( cmd.getHandle (), image, sourceStage, destinationStage, srcAccessMask, dstAccessMask, oldLayout, newLayout );
+	}
+
+	static void	transitionLayout ( VkCommandBuffer cmd, VkImage image, VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, 
+								   VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldLayout, VkImageLayout newLayout )
 	{
 		VkImageMemoryBarrier	barrier       = {};
 
@@ -372,7 +421,7 @@ public:
 		barrier.dstAccessMask                   = dstAccessMask;
 
 		vkCmdPipelineBarrier (
-			cmd.getHandle (),
+			cmd,
 			sourceStage, destinationStage,
 			0,
 			0, nullptr,
@@ -384,6 +433,7 @@ public:
 class	Sampler
 {
 	VkDevice				device        = VK_NULL_HANDLE;
+	Device				  * owner         = nullptr;			// notified when sampler is destroyed
 	VkSampler				sampler       = VK_NULL_HANDLE;
 	VkFilter				minFilter     = VK_FILTER_NEAREST;	//LINEAR;
 	VkFilter				magFilter     = VK_FILTER_NEAREST;	//LINEAR;
@@ -412,6 +462,8 @@ public:
 	
 	void	clean ()
 	{
+		DescriptorSetCache::forget ( owner, sampler );
+
 		if ( sampler != VK_NULL_HANDLE )
 	        vkDestroySampler ( device, sampler, nullptr );
 		
@@ -478,6 +530,7 @@ public:
 	void create ( Device& dev ) 
 	{
 		device = dev.getDevice ();
+		owner  = &dev;
 		
 		VkSamplerCreateInfo samplerInfo = {};
 	
@@ -517,6 +570,8 @@ public:
 	
 	void	clean ()
 	{
+		DescriptorSetCache::forget ( image.getOwner (), imageView );
+
 		image.clean ();
 		
 		if ( imageView != VK_NULL_HANDLE )
@@ -525,6 +580,29 @@ public:
 		imageView = VK_NULL_HANDLE;
 	}
 
+			// destroy view and image after frames that may still use them are retired
+	void	deferredClean ()
+	{
+		DeletionQueue * queue = image.getDeletionQueue ();
+
+		DescriptorSetCache::forget ( image.getOwner (), imageView );
+
+		if ( imageView != VK_NULL_HANDLE )
+		{
+			VkDevice	dev  = image.getDevice ();
+			VkImageView	view = imageView;
+
+			if ( queue != nullptr )
+				queue->push ( [dev, view] () { vkDestroyImageView ( dev, view, nullptr ); } );
+			else
+				vkDestroyImageView ( dev, view, nullptr );
+		}
+
+		imageView = VK_NULL_HANDLE;
+
+		image.deferredClean ();
+	}
+
 	Image&	getImage ()
 	{
 		return image;
@@ -592,7 +670,12 @@ public:
 	}
 	
 	
-	void	generateMipmaps ( SingleTimeCommand& cmd, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels ) 
+	void	generateMipmaps ( SingleTimeCommand& cmd, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels )
+	{
+		generateMipmaps ( cmd.getHandle (), imageFormat, texWidth, texHeight, mipLevels );
+	}
+
+	void	generateMipmaps ( VkCommandBuffer cmd, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels ) 
 	{
 			// Check if image format supports linear blitting
 		VkFormatProperties formatProperties;
@@ -624,7 +707,7 @@ public:
 			barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
 			barrier.dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
 
-			vkCmdPipelineBarrier ( cmd.getHandle (),
+			vkCmdPipelineBarrier ( cmd,
 				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
 				0, nullptr, 0, nullptr, 1, &barrier );
 
@@ -643,7 +726,7 @@ public:
 			blit.dstSubresource.baseArrayLayer = 0;
 			blit.dstSubresource.layerCount     = 1;
 
-			vkCmdBlitImage ( cmd.getHandle (),
+			vkCmdBlitImage ( cmd,
 				image.getHandle (), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 				image.getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				1, &blit, VK_FILTER_LINEAR );
@@ -653,7 +736,7 @@ public:
 			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-			vkCmdPipelineBarrier ( cmd.getHandle (),
+			vkCmdPipelineBarrier ( cmd,
 				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 				0, nullptr, 0, nullptr, 1, &barrier );
 
@@ -670,13 +753,14 @@ public:
 		barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
 
-		vkCmdPipelineBarrier ( cmd.getHandle (),
+		vkCmdPipelineBarrier ( cmd,
 			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 			0, nullptr, 0, nullptr, 1, &barrier );
 	}
 	
 	void load2D ( Device& dev, const std::string& fileName, bool mipmaps = true )
 	{
+		TraceScope		trace ( "load2D", fileName );
 		int				texWidth, texHeight, texChannels;
 		stbi_uc       * pixels    = stbi_load ( fileName.c_str (), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha );
 		VkDeviceSize	imageSize = texWidth * texHeight * 4;
@@ -685,31 +769,35 @@ public:
 		if ( !pixels )
 			fatal () << "Texture: failed to load texture image! " << fileName << Log::endl;
 
-		Buffer	stagingBuffer;
-		
-		stagingBuffer.create ( dev, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-		stagingBuffer.copy   ( pixels, imageSize );
+			// TRANSFER_SRC for mipmap calculations via vkCmdBlitImage
+		create ( dev, texWidth, texHeight, 1, mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+			// copy is recorded into current upload batch, it is submitted before next frame
+		UploadManager&			uploader = *dev.getUploader ();
+		UploadManager::Range	staging  = uploader.stage ( imageSize );
+
+		memcpy ( staging.ptr, pixels, imageSize );
 
 		stbi_image_free ( pixels );
 
-			// TRANSFER_SRC for mipmap calculations via vkCmdBlitImage
-		create ( dev, texWidth, texHeight, 1, mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		VkCommandBuffer	cmd = uploader.getCommandBuffer ();
 
-		{
-			SingleTimeCommand	cmd ( dev );
-			
-			image.transitionLayout  ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-			image.copyFromBuffer    ( cmd, stagingBuffer, texWidth, texHeight, 1 );
+		image.transitionLayout  ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+		image.copyFromBuffer    ( cmd, staging.buffer, staging.offset, texWidth, texHeight, 1 );
+
+			// blits need graphics queue
+		cmd = uploader.acquireImage ( image.getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels );
 			
-			if ( mipmaps )
-				generateMipmaps     ( cmd, image.getFormat (), texWidth, texHeight, mipLevels );
-			else
-				image.transitionLayout ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-		}
+		if ( mipmaps )
+			generateMipmaps     ( cmd, image.getFormat (), texWidth, texHeight, mipLevels );
+		else
+			image.transitionLayout ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
 	}
 
 	void	loadCubemap ( Device& dev, const std::vector<const char *>& files, bool mipmaps = true )
 	{
+		TraceScope	trace ( "loadCubemap", files.empty () ? "" : files [0] );
+
 		assert ( files.size () == 6 );
 
 		struct
@@ -732,17 +820,17 @@ public:
 		VkDeviceSize	faceSize  = width * width * 4;
 		VkDeviceSize	imageSize = faceSize * 6;
 		uint32_t		mipLevels = static_cast<uint32_t>(std::floor(std::log2(width))) + 1;
-		Buffer			stagingBuffer;
+		UploadManager&	uploader  = *dev.getUploader ();
 		
 		if ( !mipmaps )
 			mipLevels = 1;
 		
-				// copy all data to staging buffer
-		stagingBuffer.create ( dev, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+				// copy all data to staging ring
+		UploadManager::Range	staging = uploader.stage ( imageSize );
 		
 		for ( int i = 0; i < 6; i++ )
 		{
-			stagingBuffer.copy   ( faces [i].pixels, faceSize, i*faceSize );
+			memcpy ( (uint8_t *) staging.ptr + i*faceSize, faces [i].pixels, faceSize );
 
 			stbi_image_free ( faces [i].pixels );
 		}
@@ -756,17 +844,17 @@ public:
 		if ( image.getFormat () == VK_FORMAT_D32_SFLOAT || image.getFormat () == VK_FORMAT_D32_SFLOAT_S8_UINT || image.getFormat () == VK_FORMAT_D24_UNORM_S8_UINT )
 			aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
 		
-		{
-			SingleTimeCommand	cmd ( dev );
+		VkCommandBuffer	cmd = uploader.getCommandBuffer ();
 			
-			image.transitionLayout  ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
-			image.copyFromBuffer    ( cmd, stagingBuffer, width, width, 1, 6 );
+		image.transitionLayout  ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+		image.copyFromBuffer    ( cmd, staging.buffer, staging.offset, width, width, 1, 6 );
 
-			if ( mipmaps )
-				generateMipmaps     ( cmd, image.getFormat (), width, width, mipLevels );
-			else
-				image.transitionLayout ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-		}
+		cmd = uploader.acquireImage ( image.getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, 6 );
+
+		if ( mipmaps )
+			generateMipmaps     ( cmd, image.getFormat (), width, width, mipLevels );
+		else
+			image.transitionLayout ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
 		
 		createImageView ( aspectFlags, VK_IMAGE_VIEW_TYPE_CUBE );
 	}
@@ -0,0 +1,252 @@
+//
+// Low-overhead CPU tracing with export to Chrome trace-event JSON
+// (open in chrome://tracing or ui.perfetto.dev).
+// Every thread appends complete events to its own buffer, a disabled
+// TraceScope costs one atomic load
+//
+
+#pragma once
+
+#include	<atomic>
+#include	<chrono>
+#include	<memory>
+#include	<mutex>
+#include	<string>
+#include	<vector>
+#include	<stdio.h>
+#include	"Log.h"
+
+class	Trace
+{
+	struct	Event
+	{
+		const char * name;				// must be a literal or otherwise outlive trace
+		std::string	 arg;				// optional detail, e.g. file name
+		int64_t		 start;				// microseconds since trace epoch
+		int64_t		 duration;
+	};
+
+	struct	ThreadBuffer
+	{
+		uint32_t			tid;
+		std::string			name;
+		std::vector<Event>	events;
+		size_t				dropped = 0;
+		std::mutex			mutex;		// taken by export only, so uncontended while tracing
+	};
+
+	typedef std::vector<std::shared_ptr<ThreadBuffer>>	Registry;
+
+public:
+	enum
+	{
+		maxEventsPerThread = 1 << 20
+	};
+
+	static bool	isEnabled ()
+	{
+		return enabledFlag ().load ( std::memory_order_relaxed );
+	}
+
+				// start recording, call before window is created to trace startup as well
+	static void	start ()
+	{
+		epoch ();
+		enabledFlag ().store ( true );
+	}
+
+	static void	stop ()
+	{
+		enabledFlag ().store ( false );
+	}
+
+				// microseconds since trace epoch
+	static int64_t	now ()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now () - epoch () ).count ();
+	}
+
+	static void	setThreadName ( const std::string& name )
+	{
+		ThreadBuffer&				buf = threadBuffer ();
+		std::lock_guard<std::mutex>	lock ( buf.mutex );
+
+		buf.name = name;
+	}
+
+	static void	add ( const char * name, std::string&& arg, int64_t start, int64_t end )
+	{
+		ThreadBuffer&				buf = threadBuffer ();
+		std::lock_guard<std::mutex>	lock ( buf.mutex );
+
+		if ( buf.events.size () >= maxEventsPerThread )
+		{
+			buf.dropped++;
+			return;
+		}
+
+		buf.events.push_back ( { name, std::move ( arg ), start, end - start } );
+	}
+
+				// drop all recorded events
+	static void	clear ()
+	{
+		std::lock_guard<std::mutex>	lock ( registryMutex () );
+
+		for ( auto& b : registry () )
+		{
+			std::lock_guard<std::mutex>	bufLock ( b->mutex );
+
+			b->events.clear ();
+			b->dropped = 0;
+		}
+	}
+
+				// write all events as Chrome trace-event JSON, may be called while tracing
+	static bool	exportChrome ( const std::string& fileName )
+	{
+		FILE  * fp = fopen ( fileName.c_str (), "w" );
+
+		if ( fp == nullptr )
+		{
+			log () << "Trace: cannot write " << fileName << Log::endl;
+
+			return false;
+		}
+
+		size_t						count = 0;
+		std::lock_guard<std::mutex>	lock ( registryMutex () );
+
+		fprintf ( fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+		fprintf ( fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"vulkan-tests\"}}" );
+
+		for ( auto& b : registry () )
+		{
+			std::lock_guard<std::mutex>	bufLock ( b->mutex );
+
+			if ( !b->name.empty () )
+				fprintf ( fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}", b->tid, escape ( b->name ).c_str () );
+
+			for ( auto& e : b->events )
+			{
+				fprintf ( fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %lld, \"dur\": %lld",
+						  escape ( e.name ).c_str (), b->tid, (long long) e.start, (long long) e.duration );
+
+				if ( !e.arg.empty () )
+					fprintf ( fp, ", \"args\": {\"detail\": \"%s\"}", escape ( e.arg ).c_str () );
+
+				fprintf ( fp, "}" );
+			}
+
+			if ( b->dropped > 0 )
+				log () << "Trace: thread " << b->tid << " dropped " << b->dropped << " events" << Log::endl;
+
+			count += b->events.size ();
+		}
+
+		fprintf ( fp, "\n]}\n" );
+		fclose  ( fp );
+
+		log () << "Trace: " << count << " events written to " << fileName << Log::endl;
+
+		return true;
+	}
+
+private:
+	static std::atomic<bool>&	enabledFlag ()
+	{
+		static std::atomic<bool>	flag ( false );
+
+		return flag;
+	}
+
+	static std::chrono::steady_clock::time_point	epoch ()
+	{
+		static std::chrono::steady_clock::time_point	t = std::chrono::steady_clock::now ();
+
+		return t;
+	}
+
+	static std::mutex&	registryMutex ()
+	{
+		static std::mutex	m;
+
+		return m;
+	}
+
+	static Registry&	registry ()
+	{
+		static Registry	r;
+
+		return r;
+	}
+
+				// buffer of calling thread, registered on first use and kept after thread exits
+	static ThreadBuffer&	threadBuffer ()
+	{
+		thread_local std::shared_ptr<ThreadBuffer>	buf;
+
+		if ( !buf )
+		{
+			std::lock_guard<std::mutex>	lock ( registryMutex () );
+
+			buf      = std::make_shared<ThreadBuffer> ();
+			buf->tid = (uint32_t) registry ().size () + 1;
+
+			registry ().push_back ( buf );
+		}
+
+		return *buf;
+	}
+
+	static std::string	escape ( const std::string& s )
+	{
+		std::string	res;
+
+		for ( char c : s )
+			if ( c == '"' || c == '\\' )
+			{
+				res += '\\';
+				res += c;
+			}
+			else
+			if ( (unsigned char) c >= ' ' )
+				res += c;
+
+		return res;
+	}
+};
+
+		// RAII scope recorded as one complete event, name should be a string literal
+class	TraceScope
+{
+	const char * name;
+	std::string	 arg;
+	int64_t		 start  = 0;
+	bool		 active = false;
+
+public:
+	explicit TraceScope ( const char * n ) : name ( n ), active ( Trace::isEnabled () )
+	{
+		if ( active )
+			start = Trace::now ();
+	}
+
+	TraceScope ( const char * n, const std::string& detail ) : name ( n ), active ( Trace::isEnabled () )
+	{
+		if ( active )
+		{
+			arg   = detail;
+			start = Trace::now ();
+		}
+	}
+
+	TraceScope ( const TraceScope& ) = delete;
+	TraceScope& operator = ( const TraceScope& ) = delete;
+
+	~TraceScope ()
+	{
+		if ( active )
+			Trace::add ( name, std::move ( arg ), start, Trace::now () );
+	}
+};
@@ -0,0 +1,142 @@
+//
+// Per-frame ring of uniform data in one persistently mapped buffer.
+// Each frame in flight owns its own region, uniforms are appended to it
+// and bound with dynamic offsets, so nothing is mapped or allocated per frame
+//
+
+#pragma once
+
+#include	"Log.h"
+#include	"Device.h"
+#include	"Buffer.h"
+
+class	UniformRing
+{
+	Buffer			buffer;
+	VkDeviceSize	frameSize = 0;			// aligned size of one frame region
+	VkDeviceSize	alignment = 1;			// required alignment of dynamic offsets
+	uint32_t		numFrames = 0;
+	uint32_t		frame     = 0;			// current frame region
+	VkDeviceSize	head      = 0;			// first free byte in current region
+
+public:
+	struct	Range
+	{
+		void	  * ptr    = nullptr;		// where to write data
+		uint32_t	offset = 0;				// dynamic offset to bind with
+		VkDeviceSize	size   = 0;
+	};
+
+	UniformRing () = default;
+	~UniformRing ()
+	{
+		clean ();
+	}
+
+	Buffer&	getBuffer ()
+	{
+		return buffer;
+	}
+
+	VkBuffer	getHandle () const
+	{
+		return buffer.getHandle ();
+	}
+
+	VkDeviceSize	getAlignment () const
+	{
+		return alignment;
+	}
+
+	VkDeviceSize	getFrameSize () const
+	{
+		return frameSize;
+	}
+
+	uint32_t	getFrameCount () const
+	{
+		return numFrames;
+	}
+
+			// offset of the start of frame region, data pushed first goes there
+	uint32_t	frameOffset ( uint32_t index ) const
+	{
+		return (uint32_t)(index * frameSize);
+	}
+
+	void	clean ()
+	{
+		buffer.clean ();
+
+		frameSize = 0;
+		numFrames = 0;
+		frame     = 0;
+		head      = 0;
+	}
+
+	bool	create ( Device& dev, uint32_t frames, VkDeviceSize bytesPerFrame, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT )
+	{
+		const VkPhysicalDeviceLimits&	limits = dev.getLimits ();
+
+		alignment = std::max ( limits.minUniformBufferOffsetAlignment, (VkDeviceSize) 1 );
+
+		if ( usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT )
+			alignment = std::max ( alignment, limits.minStorageBufferOffsetAlignment );
+
+		numFrames = frames;
+		frameSize = align ( bytesPerFrame );
+		frame     = 0;
+		head      = 0;
+
+			// no HOST_COHERENT requirement - we flush written range explicitly
+		return buffer.create ( dev, frameSize * numFrames, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
+	}
+
+			// start writing into region of given frame, previous contents of it must be no longer used by GPU
+	void	beginFrame ( uint32_t index )
+	{
+		assert ( index < numFrames );
+
+		frame = index;
+		head  = 0;
+	}
+
+	Range	alloc ( VkDeviceSize size )
+	{
+		Range	range;
+
+		if ( head + size > frameSize )
+			fatal () << "UniformRing: frame region overflow, " << head + size << " bytes of " << frameSize << Log::endl;
+
+		range.offset = (uint32_t)(frame * frameSize + head);
+		range.ptr    = (char *) buffer.getMemory ().map ( size, range.offset );
+		range.size   = size;
+		head        += align ( size );
+
+		return range;
+	}
+
+			// copy data into current frame region, returns dynamic offset for it
+	template <typename T>
+	uint32_t	push ( const T& data )
+	{
+		Range	range = alloc ( sizeof ( T ) );
+
+		memcpy ( range.ptr, &data, sizeof ( T ) );
+
+		return range.offset;
+	}
+
+			// make everything written in this frame visible to GPU
+	void	flush ()
+	{
+		if ( head > 0 )
+			buffer.getMemory ().flush ( frame * frameSize, head );
+	}
+
+private:
+	VkDeviceSize	align ( VkDeviceSize size ) const
+	{
+		return ((size + alignment - 1) / alignment) * alignment;
+	}
+};
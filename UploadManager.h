@@ -0,0 +1,587 @@
+//
+// Batched asynchronous uploads to device-local buffers and images.
+// Data is written into a persistently mapped staging ring, copies are
+// recorded into one command buffer per batch and submitted without waiting.
+// Every batch gets a ticket, completion of which can be polled or waited for.
+// If device has a dedicated transfer queue copies go there, and resources are
+// handed over to graphics family by release/acquire barriers
+//
+
+#pragma once
+
+#include	<vector>
+#include	<deque>
+#include	<chrono>
+#include	<cstring>
+#include	"Log.h"
+#include	"Device.h"
+#include	"Buffer.h"
+#include	"Trace.h"
+
+struct	UploadStats
+{
+	uint64_t	bytes       = 0;		// bytes copied by retired batches
+	uint64_t	copies      = 0;		// number of copy commands recorded
+	uint64_t	batches     = 0;		// number of submitted batches
+	uint64_t	stalls      = 0;		// how many times we had to wait for GPU
+	double		stallTime   = 0;		// seconds spent on CPU waiting for batches
+	double		activeTime  = 0;		// seconds between submit and observed completion of batches
+
+	double	bytesPerSecond () const
+	{
+		return activeTime > 0 ? bytes / activeTime : 0;
+	}
+};
+
+class	UploadManager
+{
+public:
+	struct	Range
+	{
+		void	  * ptr    = nullptr;			// where to write data
+		VkBuffer	buffer = VK_NULL_HANDLE;	// staging buffer to copy from
+		VkDeviceSize	offset = 0;				// offset in it
+	};
+
+private:
+	typedef std::chrono::steady_clock	clock;
+
+	struct	Batch
+	{
+		VkCommandBuffer		cmd        = VK_NULL_HANDLE;		// copies, on transfer queue
+		VkCommandBuffer		acquireCmd = VK_NULL_HANDLE;		// acquire barriers, on graphics queue
+		VkSemaphore			semaphore  = VK_NULL_HANDLE;		// transfer -> graphics submit
+		VkFence				fence    = VK_NULL_HANDLE;
+		uint64_t			ticket   = 0;
+		VkDeviceSize		begin    = 0;		// ring range used by this batch
+		VkDeviceSize		end      = 0;
+		VkDeviceSize		ringUsed = 0;		// bytes of ring taken including padding
+		VkDeviceSize		bytes    = 0;		// bytes of payload
+		std::vector<Buffer *>	tempBuffers;	// staging for uploads bigger than ring
+		clock::time_point	submitTime;
+	};
+
+	Device			  * device        = nullptr;
+	VkCommandPool		commandPool   = VK_NULL_HANDLE;		// graphics family
+	VkCommandPool		transferPool  = VK_NULL_HANDLE;		// owned by device
+	VkQueue				queue         = VK_NULL_HANDLE;
+	VkQueue				transferQueue = VK_NULL_HANDLE;
+	uint32_t			graphicsFamily = 0;
+	uint32_t			transferFamily = 0;
+	bool				separate      = false;		// transfer family differs from graphics
+	Buffer				staging;
+	uint8_t			  * stagingPtr    = nullptr;
+	VkDeviceSize		ringSize      = 0;
+	VkDeviceSize		head          = 0;		// next free byte in ring
+	VkDeviceSize		tail          = 0;		// oldest byte still used by GPU
+	VkDeviceSize		used          = 0;		// bytes between tail and head
+	Batch			  * current       = nullptr;	// batch being recorded
+	std::deque<Batch *>	inFlight;				// submitted, in submission order
+	std::vector<Batch *>	freeBatches;
+	uint64_t			nextTicket    = 1;
+	uint64_t			completed     = 0;		// all tickets up to this are done
+	clock::time_point	lastRetire;
+	UploadStats			stats;
+
+public:
+	UploadManager ( Device& dev, VkDeviceSize stagingSize = 32*1024*1024 ) : device ( &dev )
+	{
+		VkCommandPoolCreateInfo	poolInfo = {};
+
+		poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = device->getGraphicsFamilyIndex ();
+		poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		queue                     = device->getGraphicsQueue ();
+		separate                  = device->hasTransferQueue () && device->getTransferCommandPool () != VK_NULL_HANDLE;
+		graphicsFamily            = device->getGraphicsFamilyIndex ();
+		transferFamily            = separate ? device->getTransferFamilyIndex () : graphicsFamily;
+		transferQueue             = separate ? device->getTransferQueue () : queue;
+
+		if ( vkCreateCommandPool ( device->getDevice (), &poolInfo, nullptr, &commandPool ) != VK_SUCCESS )
+			fatal () << "UploadManager: failed to create command pool!" << Log::endl;
+
+		transferPool = separate ? device->getTransferCommandPool () : commandPool;
+
+		ringSize   = stagingSize;
+		lastRetire = clock::now ();
+
+		staging.create ( dev, ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
+
+		stagingPtr = (uint8_t *) staging.getMemory ().map ( ringSize );
+	}
+
+	~UploadManager ()
+	{
+		finish ();
+
+		for ( auto b : freeBatches )
+		{
+			vkFreeCommandBuffers ( device->getDevice (), transferPool, 1, &b->cmd );
+			vkDestroyFence       ( device->getDevice (), b->fence, nullptr );
+
+			if ( separate )
+			{
+				vkFreeCommandBuffers ( device->getDevice (), commandPool, 1, &b->acquireCmd );
+				vkDestroySemaphore   ( device->getDevice (), b->semaphore, nullptr );
+			}
+
+			delete b;
+		}
+
+		staging.clean ();
+		vkDestroyCommandPool ( device->getDevice (), commandPool, nullptr );
+	}
+
+	const UploadStats&	getStats () const
+	{
+		return stats;
+	}
+
+	void	resetStats ()
+	{
+		stats = UploadStats ();
+	}
+
+	void	dumpStats () const
+	{
+		log () << "UploadManager: " << (unsigned long long) stats.bytes << " bytes in " << (unsigned long long) stats.batches << " batches, "
+			   << (unsigned long long) stats.copies << " copies, " << stats.bytesPerSecond () / (1024.0 * 1024.0) << " MB/s, "
+			   << (unsigned long long) stats.stalls << " stalls, " << stats.stallTime * 1000.0 << " ms stalled" << Log::endl;
+	}
+
+			// ticket of batch currently being recorded, it is not submitted yet
+	uint64_t	currentTicket () const
+	{
+		return nextTicket;
+	}
+
+	bool	hasPending () const
+	{
+		return current != nullptr;
+	}
+
+			// get memory in staging ring, must be filled before submit ()
+			// may submit current batch, so get command buffer only after staging
+	Range	stage ( VkDeviceSize size, VkDeviceSize alignment = 16 )
+	{
+		Range			range;
+		VkDeviceSize	offset;
+
+		if ( size + alignment > ringSize )
+			return stageTemp ( size );
+
+		while ( !ringAlloc ( size, alignment, offset ) )
+		{
+			if ( current != nullptr && current->ringUsed > 0 )
+				submit ();
+
+			if ( inFlight.empty () )
+				return stageTemp ( size );
+
+			TraceScope	trace ( "UploadManager::waitOldest" );		// staging ring is full
+
+			waitOldest ();
+		}
+
+		current->end    = offset + size;
+		current->bytes += size;
+		range.ptr       = stagingPtr + offset;
+		range.buffer    = staging.getHandle ();
+		range.offset    = offset;
+
+		return range;
+	}
+
+	bool	usesTransferQueue () const
+	{
+		return separate;
+	}
+
+			// command buffer of current batch, valid until next stage () or submit ()
+			// it may run on transfer queue, so only copies and layout transitions are allowed there
+	VkCommandBuffer	getCommandBuffer ()
+	{
+		begin ();
+
+		return current->cmd;
+	}
+
+			// command buffer executed on graphics queue after all copies of current batch,
+			// use it for blits and transitions to shader layouts
+	VkCommandBuffer	getGraphicsCommandBuffer ()
+	{
+		begin ();
+
+		return separate ? current->acquireCmd : current->cmd;
+	}
+
+			// pass image written in this batch to graphics family, keeping its layout
+			// returns command buffer to record further graphics work on it
+	VkCommandBuffer	acquireImage ( VkImage image, VkImageLayout layout, uint32_t mipLevels = 1, uint32_t layers = 1, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT )
+	{
+		begin ();
+
+		if ( !separate )
+			return current->cmd;
+
+		VkImageMemoryBarrier	barrier = {};
+
+		barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout                       = layout;
+		barrier.newLayout                       = layout;
+		barrier.srcQueueFamilyIndex             = transferFamily;
+		barrier.dstQueueFamilyIndex             = graphicsFamily;
+		barrier.image                           = image;
+		barrier.subresourceRange.aspectMask     = aspect;
+		barrier.subresourceRange.baseMipLevel   = 0;
+		barrier.subresourceRange.levelCount     = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount     = layers;
+
+				// release on transfer queue
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier ( current->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+				// acquire on graphics queue
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier ( current->acquireCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		return current->acquireCmd;
+	}
+
+	uint64_t	uploadBuffer ( Buffer& dst, const void * data, VkDeviceSize size, VkDeviceSize dstOffset = 0 )
+	{
+		TraceScope		trace  ( "UploadManager::uploadBuffer" );
+		Range			range  = stage ( size, 4 );
+		VkBufferCopy	region = {};
+
+		memcpy ( range.ptr, data, size );
+
+		region.srcOffset = range.offset;
+		region.dstOffset = dstOffset;
+		region.size      = size;
+
+		vkCmdCopyBuffer ( getCommandBuffer (), range.buffer, dst.getHandle (), 1, &region );
+		stats.copies++;
+
+		if ( separate )
+			acquireBuffer ( dst.getHandle (), dstOffset, size );
+
+		return nextTicket;
+	}
+
+			// image must already be in TRANSFER_DST_OPTIMAL layout in this batch,
+			// bufferOffset of regions is relative to data, use acquireImage after it
+	uint64_t	uploadImage ( VkImage image, const void * data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkDeviceSize alignment = 16 )
+	{
+		TraceScope						trace ( "UploadManager::uploadImage" );
+		Range							range = stage ( size, alignment );
+		std::vector<VkBufferImageCopy>	copies ( regions );
+
+		memcpy ( range.ptr, data, size );
+
+		for ( auto& r : copies )
+			r.bufferOffset += range.offset;
+
+		vkCmdCopyBufferToImage ( getCommandBuffer (), range.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t) copies.size (), copies.data () );
+		stats.copies++;
+
+		return nextTicket;
+	}
+
+			// submit recorded batch without waiting, returns its ticket
+	uint64_t	submit ()
+	{
+		if ( current == nullptr )
+			return nextTicket - 1;
+
+		TraceScope		trace ( "UploadManager::submit" );
+		VkMemoryBarrier	barrier    = {};
+		VkSubmitInfo	submitInfo = {};
+
+		VkCommandBuffer	last       = getGraphicsCommandBuffer ();
+
+				// make copied data visible to everything submitted later to graphics queue
+		barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+		vkCmdPipelineBarrier ( last, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+		vkEndCommandBuffer   ( current->cmd );
+
+		flushRing ( current->begin, current->end );
+
+		submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers    = &current->cmd;
+
+		if ( separate )
+		{
+			VkPipelineStageFlags	waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+					// copies on transfer queue, then acquire on graphics one
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores    = &current->semaphore;
+
+			if ( device->submit ( transferQueue, 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
+				fatal () << "UploadManager: failed to submit upload batch!" << Log::endl;
+
+			vkEndCommandBuffer ( current->acquireCmd );
+
+			submitInfo                    = {};
+			submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores    = &current->semaphore;
+			submitInfo.pWaitDstStageMask  = &waitStage;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers    = &current->acquireCmd;
+		}
+
+		if ( device->submit ( queue, 1, &submitInfo, current->fence ) != VK_SUCCESS )
+			fatal () << "UploadManager: failed to submit upload batch!" << Log::endl;
+
+		current->submitTime = clock::now ();
+
+		inFlight.push_back ( current );
+		stats.batches++;
+
+		current = nullptr;
+
+		return nextTicket++;
+	}
+
+			// retire finished batches, never blocks
+	void	poll ()
+	{
+		while ( !inFlight.empty () && vkGetFenceStatus ( device->getDevice (), inFlight.front ()->fence ) == VK_SUCCESS )
+			retire ();
+	}
+
+	bool	isComplete ( uint64_t ticket )
+	{
+		poll ();
+
+		return ticket <= completed;
+	}
+
+			// block until batch with given ticket is done, submitting it if needed
+	void	wait ( uint64_t ticket )
+	{
+		if ( current != nullptr && ticket >= nextTicket )
+			submit ();
+
+		poll ();
+
+		while ( completed < ticket && !inFlight.empty () )
+			waitOldest ();
+	}
+
+			// submit everything and wait for it
+	void	finish ()
+	{
+		wait ( submit () );
+	}
+
+private:
+	void	begin ()
+	{
+		if ( current != nullptr )
+			return;
+
+		if ( freeBatches.empty () )
+		{
+			VkCommandBufferAllocateInfo	allocInfo = {};
+			VkFenceCreateInfo			fenceInfo = {};
+			Batch					  * batch     = new Batch;
+
+			allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool        = transferPool;
+			allocInfo.commandBufferCount = 1;
+			fenceInfo.sType              = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+			if ( vkAllocateCommandBuffers ( device->getDevice (), &allocInfo, &batch->cmd ) != VK_SUCCESS )
+				fatal () << "UploadManager: failed to allocate command buffer!" << Log::endl;
+
+			vkCreateFence ( device->getDevice (), &fenceInfo, nullptr, &batch->fence );
+
+			if ( separate )
+			{
+				VkSemaphoreCreateInfo	semaphoreInfo = {};
+
+				allocInfo.commandPool = commandPool;
+				semaphoreInfo.sType   = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+				if ( vkAllocateCommandBuffers ( device->getDevice (), &allocInfo, &batch->acquireCmd ) != VK_SUCCESS )
+					fatal () << "UploadManager: failed to allocate command buffer!" << Log::endl;
+
+				vkCreateSemaphore ( device->getDevice (), &semaphoreInfo, nullptr, &batch->semaphore );
+			}
+			freeBatches.push_back ( batch );
+		}
+
+		VkCommandBufferBeginInfo	beginInfo = {};
+
+		current = freeBatches.back ();
+		freeBatches.pop_back ();
+
+		current->ticket   = nextTicket;
+		current->begin    = head;
+		current->end      = head;
+		current->ringUsed = 0;
+		current->bytes    = 0;
+		beginInfo.sType   = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags   = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkResetCommandBuffer ( current->cmd, 0 );
+		vkBeginCommandBuffer ( current->cmd, &beginInfo );
+
+		if ( separate )
+		{
+			vkResetCommandBuffer ( current->acquireCmd, 0 );
+			vkBeginCommandBuffer ( current->acquireCmd, &beginInfo );
+		}
+	}
+
+			// release buffer range on transfer queue and acquire it on graphics one
+	void	acquireBuffer ( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size )
+	{
+		VkBufferMemoryBarrier	barrier = {};
+
+		barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.buffer              = buffer;
+		barrier.offset              = offset;
+		barrier.size                = size;
+		barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask       = 0;
+
+		vkCmdPipelineBarrier ( current->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr );
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+		vkCmdPipelineBarrier ( current->acquireCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr );
+	}
+
+	bool	ringAlloc ( VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset )
+	{
+		if ( used == 0 )
+			head = tail = 0;
+
+		if ( used + size > ringSize )
+			return false;
+
+		VkDeviceSize	pos   = ((head + alignment - 1) / alignment) * alignment;
+		VkDeviceSize	taken = 0;
+
+		if ( head >= tail )			// free space is [head, ringSize) and [0, tail)
+		{
+			if ( pos + size <= ringSize )
+				taken = pos + size - head;
+			else
+			if ( size <= tail )		// wrap around
+			{
+				pos   = 0;
+				taken = ringSize - head + size;
+			}
+			else
+				return false;
+		}
+		else						// free space is [head, tail)
+		{
+			if ( pos + size > tail )
+				return false;
+
+			taken = pos + size - head;
+		}
+
+		if ( used + taken > ringSize )
+			return false;
+
+		begin ();
+
+		if ( current->ringUsed == 0 )
+			current->begin = pos;
+
+		offset             = pos;
+		head               = pos + size;
+		used              += taken;
+		current->ringUsed += taken;
+
+		return true;
+	}
+
+	Range	stageTemp ( VkDeviceSize size )
+	{
+		Range	range;
+		Buffer * buf = new Buffer ( *device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+
+		begin ();
+
+		current->tempBuffers.push_back ( buf );
+		current->bytes += size;
+		range.ptr       = buf->getMemory ().map ( size );
+		range.buffer    = buf->getHandle ();
+		range.offset    = 0;
+
+		return range;
+	}
+
+	void	flushRing ( VkDeviceSize from, VkDeviceSize to )
+	{
+		if ( current->ringUsed == 0 )
+			return;
+
+		if ( to > from )
+			staging.getMemory ().flush ( from, to - from );
+		else
+		{
+			staging.getMemory ().flush ( from, ringSize - from );
+			staging.getMemory ().flush ( 0, to );
+		}
+	}
+
+	void	waitOldest ()
+	{
+		auto	start = clock::now ();
+
+		vkWaitForFences ( device->getDevice (), 1, &inFlight.front ()->fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT );
+
+		stats.stalls++;
+		stats.stallTime += std::chrono::duration<double> ( clock::now () - start ).count ();
+
+		retire ();
+	}
+
+	void	retire ()
+	{
+		Batch * batch = inFlight.front ();
+		auto	now   = clock::now ();
+
+		inFlight.pop_front ();
+		vkResetFences ( device->getDevice (), 1, &batch->fence );
+
+		for ( auto b : batch->tempBuffers )
+			delete b;
+
+		batch->tempBuffers.clear ();
+
+		stats.bytes      += batch->bytes;
+		stats.activeTime += std::chrono::duration<double> ( now - std::max ( batch->submitTime, lastRetire ) ).count ();
+		used             -= batch->ringUsed;
+		completed         = batch->ticket;
+		lastRetire        = now;
+
+		if ( batch->ringUsed > 0 )
+			tail = batch->end;
+
+
+		freeBatches.push_back ( batch );
+	}
+};
@@ -1,6 +1,13 @@
 #include	"VulkanWindow.h"
 #include	"Buffer.h"
 #include	"Texture.h"
+#include	"UploadManager.h"
+#include	"Trace.h"
+#include	"TgaImage.h"
+#include	"Controller.h"
+#include	"PipelineCache.h"
+#include	"ShaderCache.h"
+#include	"DescriptorSetCache.h"
 
 const std::vector<const char*> validationLayers = 
 {
@@ -41,7 +48,7 @@ static void _key ( GLFWwindow * window, int key, int scanCode, int action, int m
 {
 	VulkanWindow * win = (VulkanWindow *) glfwGetWindowUserPointer ( window );
 		
-	if ( win != nullptr )
+	if ( win != nullptr && !win -> isBenchmark () )		// benchmark runs take no input
 		win -> keyTyped ( key, scanCode, action, mods );
 	else
 	if ( key == GLFW_KEY_ESCAPE && action == GLFW_PRESS )
@@ -60,7 +67,7 @@ static void _mouse ( GLFWwindow* window, double xpos, double ypos )
 {
 	VulkanWindow * win = (VulkanWindow *) glfwGetWindowUserPointer (window );
 		
-	if ( win != nullptr )
+	if ( win != nullptr && !win -> isBenchmark () )
 		win -> mouseMotion ( xpos, ypos );
 }
 
@@ -68,7 +75,7 @@ static void _mouseClick ( GLFWwindow* window, int button, int action, int mods )
 {
 	VulkanWindow * win = (VulkanWindow *) glfwGetWindowUserPointer (window );
 		
-	if ( win != nullptr )
+	if ( win != nullptr && !win -> isBenchmark () )
 		win -> mouseClick ( button, action, mods );
 }
 
@@ -76,7 +83,7 @@ static void _mouseScroll ( GLFWwindow* window, double xoffset, double yoffset )
 {
 	VulkanWindow * win = (VulkanWindow *) glfwGetWindowUserPointer (window );
 		
-	if ( win != nullptr )
+	if ( win != nullptr && !win -> isBenchmark () )
 		win -> mouseWheel ( xoffset, yoffset );
 }	
 
@@ -84,6 +91,15 @@ static void _mouseScroll ( GLFWwindow* window, double xoffset, double yoffset )
 
 void VulkanWindow::initWindow ( int w, int h, const std::string& t ) 
 {
+	if ( headless )				// no display needed, w and h give size of offscreen images
+	{
+		width  = w;
+		height = h;
+		title  = t;
+
+		return;
+	}
+
 	if ( !glfwInit () )
 		fatal () << "VulkanWindow: error initializing GLFW" << Log::endl;
 		
@@ -106,6 +122,8 @@ void VulkanWindow::initWindow ( int w, int h, const std::string& t )
 
 void	VulkanWindow::initVulkan ()
 {
+	TraceScope	trace ( "VulkanWindow::initVulkan" );
+
 	createInstance      ();
 	setupDebugMessenger ();
 		
@@ -113,11 +131,23 @@ void	VulkanWindow::initVulkan ()
 	pickPhysicalDevice  ();
 	createLogicalDevice ();
 
-	swapChain.createSwapChain ( device, surface, window, width, height );
+	if ( benchmark )				// measure rendering, not display refresh rate
+		swapChain.setPresentMode ( VK_PRESENT_MODE_IMMEDIATE_KHR );
+
+	createSwapChain     ( width, height );
 
 	createCommandPool    ();
 	createDepthTexture   ();
 
+	for ( auto& pool : framePools )
+		pool.create ( device );
+
+	for ( auto& descriptors : frameDescriptors )
+		descriptors.create ( device );
+
+	device.uploader      = new UploadManager ( device );
+	device.deletionQueue = new DeletionQueue;
+
 	swapChain.createSyncObjects ();
 }
 
@@ -125,9 +155,54 @@ void	VulkanWindow::cleanup ()
 {
 	swapChain.cleanup  ();
 	depthTexture.clean ();
+
+	for ( auto& pool : framePools )
+		pool.clean ();
+
+	for ( auto& descriptors : frameDescriptors )
+	{
+		if ( descriptors.getStats ().totalSets > 0 )
+			descriptors.report ( "VulkanWindow: frame descriptors" );
+
+		descriptors.clean ();
+	}
+
+			// device is idle here, so everything pending can go
+	delete device.deletionQueue;
+
+	device.deletionQueue = nullptr;
+
+	delete device.uploader;
+
+	device.uploader = nullptr;
+
+	OneTimeCommandPool::releaseAll ( device );
 	
 	destroyCommandPool ();
 
+	delete device.allocator;
+
+	device.allocator = nullptr;
+
+	device.pipelineCache->report ();
+	device.pipelineCache->save   ();
+
+	delete device.pipelineCache;
+
+	device.pipelineCache = nullptr;
+
+	device.shaderCache->report ();
+
+	delete device.shaderCache;
+
+	device.shaderCache = nullptr;
+
+	device.descriptorSetCache->report ();
+
+	delete device.descriptorSetCache;
+
+	device.descriptorSetCache = nullptr;
+
 	vkDestroyDevice    ( device.getDevice (), nullptr );
 
 	if ( enableValidationLayers )
@@ -136,49 +211,140 @@ void	VulkanWindow::cleanup ()
 	vkDestroySurfaceKHR ( device.getInstance (), surface, nullptr );
 	vkDestroyInstance   ( device.getInstance (), nullptr );
 
-	glfwDestroyWindow   ( window );
-	glfwTerminate       ();
+	if ( window != nullptr )
+	{
+		glfwDestroyWindow ( window );
+		glfwTerminate     ();
+	}
 }
 
 void	VulkanWindow::mainLoop () 
 {
-	while ( !glfwWindowShouldClose ( window ) )
+	const RunOptions&	options   = runOptions ();
+	uint32_t			maxFrames = options.frames;
+
+	if ( benchmark && maxFrames == 0 )
+		maxFrames = RunOptions::defaultBenchmarkFrames;
+
+	if ( headless && maxFrames == 0 )
+		maxFrames = RunOptions::defaultHeadlessFrames;
+
+	if ( benchmark && benchmarkController == nullptr )
+		log () << "VulkanWindow: no benchmark controller, camera stays fixed" << Log::endl;
+
+	for ( uint32_t frameNo = 1; ; frameNo++ )
 	{
-		glfwPollEvents ();
+		if ( window != nullptr && glfwWindowShouldClose ( window ) )
+			break;
+
+		TraceScope	trace ( "frame" );
+
+		frameStats.beginFrame ();
+
+		if ( window != nullptr )
+			glfwPollEvents ();
+
+		if ( benchmarkController != nullptr )
+			benchmarkController->followPath ( getTime () );
+
 		drawFrame      ();
+
+		frameStats.beginPhase ( FrameStats::otherPhase );
+
+		if ( options.dumpEvery > 0 && frameNo % options.dumpEvery == 0 )
+			makeScreenshot ( options.dumpPrefix + std::to_string ( frameNo ) + ".tga" );
+
 		updateFps      ();
 		idle           ();
+
+		benchmarkFrame++;
+
+		if ( maxFrames > 0 && frameNo >= maxFrames )
+			break;
 	}
 
 	vkDeviceWaitIdle ( device.getDevice () );
+
+	if ( benchmark )
+		writeBenchmarkReport ( options.benchmark + ".json", benchmarkFrame );
+
+	frameStats.report ();
+
+	if ( !statsExportName.empty () )
+	{
+		frameStats.exportCsv  ( statsExportName + ".csv"  );
+		frameStats.exportJson ( statsExportName + ".json" );
+	}
 }
 
 void	VulkanWindow::recreateSwapChain ()
 {
+	TraceScope	trace ( "VulkanWindow::recreateSwapChain" );
+
 			// get new window size
-	int width = 0, height = 0;
-		
+	int width = this->width, height = this->height;
+
+	if ( window != nullptr )
+		glfwGetFramebufferSize ( window, &width, &height );
+
+			// window is minimized - wait till it is shown again
 	while ( width == 0 || height == 0 )
 	{
-		glfwGetFramebufferSize ( window, &width, &height );
 		glfwWaitEvents         ();
+		glfwGetFramebufferSize ( window, &width, &height );
 	}
 
-			// wait till can do anything
-	vkDeviceWaitIdle( device.getDevice () );
+	if ( resizeInPlace )
+	{
+				// old swap chain is passed as oldSwapchain, it and its framebuffers, together
+				// with depth texture, retire through deletion queue - no waiting here
+		depthTexture.deferredClean ();
+		createSwapChain            ( width, height );
+		createDepthTexture         ();
+		recreateFramebuffers       ();
+
+		return;
+	}
+
+			// pipelines and command buffers of upper classes are freed directly, so wait
+			// for frames using them, uploads and other queues keep going
+	swapChain.waitForFrames ();
 
 			// clean and recreate swap chain
 	cleanupSwapChain ();
-
-	swapChain.createSwapChain ( device, surface, window, width, height );
+	createSwapChain  ( width, height );
 
 			// create depth texture
 	createDepthTexture ();
 	
 			// recreate pipelines, renderpasses and command buffers
+	TraceScope	pipelinesTrace ( "createPipelines" );
+
 	createPipelines ();
 }
 
+void	VulkanWindow::setPresentMode ( VkPresentModeKHR mode )
+{
+	swapChain.setPresentMode ( mode );
+	recreateSwapChain ();
+}
+
+void	VulkanWindow::setSwapChainImageCount ( uint32_t count )
+{
+	swapChain.setImageCount ( count );
+	recreateSwapChain ();
+}
+
+void	VulkanWindow::setFramesInFlight ( uint32_t count )
+{
+			// semaphores and fences are per frame, so recreate them when nothing is in flight
+	swapChain.waitForFrames      ();
+	device.waitIdle              ( device.getPresentQueue () );		// presents may still wait on semaphores
+	swapChain.destroySyncObjects ();
+	swapChain.setFramesInFlight  ( count );
+	swapChain.createSyncObjects  ();
+}
+
 void	VulkanWindow::createInstance () 
 {
 	if ( enableValidationLayers && !checkValidationLayerSupport () )
@@ -193,7 +359,7 @@ void	VulkanWindow::createInstance ()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName        = engineName.c_str ();
 	appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion         = VK_API_VERSION_1_0;
+	appInfo.apiVersion         = VK_API_VERSION_1_1;		// exhausted descriptor pools report errors, features are queried with vkGetPhysicalDeviceFeatures2
 
 	VkInstanceCreateInfo createInfo = {};
 
@@ -221,8 +387,19 @@ void	VulkanWindow::createInstance ()
 		createInfo.pNext = nullptr;
 	}
 
-	if ( vkCreateInstance ( &createInfo, nullptr, &device.instance ) != VK_SUCCESS )
+	VkResult	res = vkCreateInstance ( &createInfo, nullptr, &device.instance );
+
+			// Vulkan 1.0 loader rejects any other version
+	if ( res == VK_ERROR_INCOMPATIBLE_DRIVER )
+	{
+		appInfo.apiVersion = VK_API_VERSION_1_0;
+		res                = vkCreateInstance ( &createInfo, nullptr, &device.instance );
+	}
+
+	if ( res != VK_SUCCESS )
 		fatal () << "VulkanWindow:failed to create instance!";
+
+	device.apiVersion = appInfo.apiVersion;
 }
 
 void	VulkanWindow::populateDebugMessengerCreateInfo ( VkDebugUtilsMessengerCreateInfoEXT& createInfo )
@@ -270,28 +447,116 @@ void	VulkanWindow::pickPhysicalDevice ()
 
 	if ( device.physicalDevice == VK_NULL_HANDLE )
 		fatal () << "VulkanWindow: failed to find a suitable GPU!";
+
+	vkGetPhysicalDeviceProperties ( device.physicalDevice, &device.properties );
 }
 
 void	VulkanWindow::createLogicalDevice ()
 {
 	QueueFamilyIndices indices              = Device::findQueueFamilies ( device.getPhysicalDevice (), surface );
-	VkDeviceQueueCreateInfo queueCreateInfo = {};
+	std::vector<VkDeviceQueueCreateInfo>	queueCreateInfos;
+	std::vector<uint32_t>					families;
+	std::vector<const char*>				extensions = deviceExtensions;
 	float queuePriority                     = 1.0f;
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	VkDeviceCreateInfo createInfo           = {};
 
-	queueCreateInfo.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueCreateInfo.queueFamilyIndex = indices.graphicsFamily;
-	queueCreateInfo.queueCount       = 1;
-	queueCreateInfo.pQueuePriorities = &queuePriority;
+			// nothing is presented, graphics queue takes role of present one
+	if ( headless )
+	{
+		indices.presentFamily = indices.graphicsFamily;
+
+				// swapchain extension is only used for PRESENT_SRC layout render passes end with
+		if ( !hasDeviceExtension ( VK_KHR_SWAPCHAIN_EXTENSION_NAME ) )
+		{
+			log () << "VulkanWindow: headless device without " << VK_KHR_SWAPCHAIN_EXTENSION_NAME << Log::endl;
+			extensions.clear ();
+		}
+	}
+
+	bool	feedback = false;				// lets pipeline cache count its hits
+
+	device.apiVersion = std::min ( device.apiVersion, device.properties.apiVersion );
+
+			// without it allocating from exhausted descriptor pool is invalid usage rather than an error
+	if ( device.apiVersion >= VK_API_VERSION_1_1 )
+		device.poolOverflowError = true;
+	else
+	if ( hasDeviceExtension ( VK_KHR_MAINTENANCE1_EXTENSION_NAME ) )
+	{
+		extensions.push_back ( VK_KHR_MAINTENANCE1_EXTENSION_NAME );
+		device.poolOverflowError = true;
+	}
+	else
+		log () << "VulkanWindow: no " << VK_KHR_MAINTENANCE1_EXTENSION_NAME << ", descriptor pools must fit all their sets" << Log::endl;
+
+#ifdef	VK_EXT_pipeline_creation_feedback
+	if ( hasDeviceExtension ( VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME ) )
+	{
+		extensions.push_back ( VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME );
+		feedback = true;
+	}
+#endif
+
+#ifdef	VK_EXT_descriptor_indexing
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT	indexing = {};
+
+			// only what bindless texture arrays need, descriptor indexing is core in 1.2 but still exposed as extension
+	if ( runOptions ().bindless && device.apiVersion >= VK_API_VERSION_1_1 && hasDeviceExtension ( VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME ) )
+	{
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT	supported = {};
+		VkPhysicalDeviceFeatures2						features  = {};
+
+		supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		features.sType  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext  = &supported;
+
+		vkGetPhysicalDeviceFeatures2 ( device.getPhysicalDevice (), &features );
+
+		if ( features.features.shaderSampledImageArrayDynamicIndexing && supported.runtimeDescriptorArray && supported.descriptorBindingPartiallyBound &&
+			 supported.descriptorBindingVariableDescriptorCount && supported.descriptorBindingSampledImageUpdateAfterBind )
+		{
+			indexing.sType                                        = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+			indexing.runtimeDescriptorArray                       = VK_TRUE;
+			indexing.descriptorBindingPartiallyBound              = VK_TRUE;
+			indexing.descriptorBindingVariableDescriptorCount     = VK_TRUE;
+			indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			indexing.shaderSampledImageArrayNonUniformIndexing    = supported.shaderSampledImageArrayNonUniformIndexing;
+			deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+			createInfo.pNext                                      = &indexing;
+			device.descriptorIndexing                             = true;
+
+			extensions.push_back ( VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME );
+		}
+	}
+#endif
+
+	if ( runOptions ().bindless )
+		log () << "VulkanWindow: bindless textures " << (device.hasDescriptorIndexing () ? "enabled" : "are not supported by device") << Log::endl;
+
+			// one queue from every distinct family we use
+	for ( uint32_t family : { indices.graphicsFamily, indices.presentFamily, indices.computeFamily, indices.transferFamily } )
+		if ( family != QueueFamilyIndices::noValue && std::find ( families.begin (), families.end (), family ) == families.end () )
+			families.push_back ( family );
+
+	for ( uint32_t family : families )
+	{
+		VkDeviceQueueCreateInfo queueCreateInfo = {};
+
+		queueCreateInfo.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo.queueFamilyIndex = family;
+		queueCreateInfo.queueCount       = 1;
+		queueCreateInfo.pQueuePriorities = &queuePriority;
 
+		queueCreateInfos.push_back ( queueCreateInfo );
+	}
 
 	createInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	createInfo.pQueueCreateInfos       = &queueCreateInfo;
-	createInfo.queueCreateInfoCount    = 1;
+	createInfo.pQueueCreateInfos       = queueCreateInfos.data ();
+	createInfo.queueCreateInfoCount    = static_cast<uint32_t>(queueCreateInfos.size ());
 	createInfo.pEnabledFeatures        = &deviceFeatures;
-	createInfo.enabledExtensionCount   = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount   = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 	createInfo.enabledLayerCount       = 0;
 
 	if ( enableValidationLayers )
@@ -306,10 +571,25 @@ void	VulkanWindow::createLogicalDevice ()
 	device.graphicsFamilyIndex = indices.graphicsFamily;
 	device.presentFamilyIndex  = indices.presentFamily;
 	device.computeFamilyIndex  = indices.computeFamily;
+	device.transferFamilyIndex = indices.transferFamily;
 
 	vkGetDeviceQueue ( device.getDevice (), indices.graphicsFamily, 0, &device.graphicsQueue );
 	vkGetDeviceQueue ( device.getDevice (), indices.presentFamily,  0, &device.presentQueue  );
 	vkGetDeviceQueue ( device.getDevice (), indices.computeFamily,  0, &device.computeQueue  );
+	vkGetDeviceQueue ( device.getDevice (), indices.transferFamily, 0, &device.transferQueue );
+
+			// families may share queue, then so do the locks
+	for ( auto q : { device.graphicsQueue, device.presentQueue, device.computeQueue, device.transferQueue } )
+		device.queueMutexes [q];
+
+	if ( device.hasTransferQueue () )
+		log () << "VulkanWindow: using dedicated transfer queue family " << indices.transferFamily << Log::endl;
+
+	device.allocator     = new MemoryAllocator ( device );
+	device.pipelineCache = new PipelineCache   ( device, runOptions ().pipelineCache, feedback );
+	device.shaderCache   = new ShaderCache     ( device );
+
+	device.descriptorSetCache = new DescriptorSetCache ( device );
 }
 
 void	VulkanWindow::createCommandPool ()
@@ -322,6 +602,21 @@ void	VulkanWindow::createCommandPool ()
 
 	if ( vkCreateCommandPool ( device.getDevice (), &poolInfo, nullptr, &device.commandPool ) != VK_SUCCESS )
 		fatal () << "VulkanWindow: failed to create command pool!" << Log::endl;
+
+			// uploads reset their command buffers individually
+	poolInfo.queueFamilyIndex = device.getTransferFamilyIndex ();
+	poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if ( vkCreateCommandPool ( device.getDevice (), &poolInfo, nullptr, &device.transferCommandPool ) != VK_SUCCESS )
+		fatal () << "VulkanWindow: failed to create transfer command pool!" << Log::endl;
+}
+
+void	VulkanWindow::createSwapChain ( int w, int h )
+{
+	if ( headless )
+		swapChain.createHeadless  ( device, w, h );
+	else
+		swapChain.createSwapChain ( device, surface, window, w, h );
 }
 
 void	VulkanWindow::createDepthTexture ()
@@ -332,7 +627,8 @@ void	VulkanWindow::createDepthTexture ()
 							  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
 		
 		
-		SingleTimeCommand	cmd ( device, device.getGraphicsQueue (), device.getCommandPool () );
+			// no need to wait - rendering is submitted later to the same queue
+		SingleTimeCommand	cmd ( device, false );
 			
 		depthTexture.getImage ().transitionLayout ( cmd, depthTexture.getImage ().getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL ); 
 	}
@@ -340,8 +636,18 @@ void	VulkanWindow::createDepthTexture ()
 
 void	VulkanWindow::drawFrame ()
 {
+	TraceScope	trace ( "drawFrame" );
+
 			// wait till we're safe to submit
-	currentImage = swapChain.acquireNextImage ();
+	frameStats.beginPhase ( FrameStats::acquirePhase );
+
+	{
+		TraceScope	acquireTrace ( "acquireNextImage" );
+
+		currentImage = swapChain.acquireNextImage ();
+	}
+
+	frameStats.beginPhase ( FrameStats::recordPhase );
 		
 	if ( currentImage == UINT32_MAX )		// we need to recreate swap chain
 	{
@@ -349,17 +655,98 @@ void	VulkanWindow::drawFrame ()
 			
 		return;
 	}
+
+				// fence of the oldest frame is signaled now, destroy what it was using
+	device.deletionQueue->beginFrame ( swapChain.getFramesInFlight () );
+				// sets of this frame are no longer in use
+	getFrameDescriptorAllocator ().reset ();
+				// pending uploads go first on the same queue
+	device.uploader->submit ();
+	device.uploader->poll   ();
+
+				// fence of this frame was waited for by acquireNextImage, so its pool can be reset
+	if ( dynamicRecording )
+	{
+		TraceScope					recordTrace ( "recordFrame" );
+		TransientCommandPool&		pool      = getFrameCommandPool ();
+		VkCommandBufferBeginInfo	beginInfo = {};
+
+		pool.reset ();
+
+		frameCommandBuffer = pool.get ();
+		beginInfo.sType    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if ( vkBeginCommandBuffer ( frameCommandBuffer, &beginInfo ) != VK_SUCCESS )
+			fatal () << "VulkanWindow: failed to begin recording frame command buffer!" << Log::endl;
+
+		recordFrame ( frameCommandBuffer, currentImage );
+
+		if ( vkEndCommandBuffer ( frameCommandBuffer ) != VK_SUCCESS )
+			fatal () << "VulkanWindow: failed to record frame command buffer!" << Log::endl;
+	}
+
 				// submit command buffers
-	submit ( currentImage );
+	{
+		TraceScope	submitTrace ( "submit" );
+
+		submit ( currentImage );
+	}
 		
-				// actually present image
-	swapChain.present ( currentImage, device.getPresentQueue () );
+				// actually present image, resize as soon as surface changed
+	frameStats.beginPhase ( FrameStats::presentPhase );
+
+	bool	presented;
+
+	{
+		TraceScope	presentTrace ( "present" );
+
+		presented = swapChain.present ( currentImage, device.getPresentQueue () );
+	}
+
+	if ( !presented )
+		recreateSwapChain ();
+}
+
+			// submit command buffer recorded by recordFrame, waiting for image and signaling frame fence
+void	VulkanWindow::submit ( uint32_t imageIndex )
+{
+	if ( frameCommandBuffer == VK_NULL_HANDLE )
+		return;
+
+	VkSubmitInfo			submitInfo          = {};
+	VkSemaphore				waitSemaphores   [] = { swapChain.currentAvailableSemaphore () };
+	VkPipelineStageFlags	waitStages       [] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	VkSemaphore				signalSemaphores [] = { swapChain.currentRenderFinishedSemaphore () };
+	VkFence					currentFence        = swapChain.currentInFlightFence ();
+
+	submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount   = 1;
+	submitInfo.pWaitSemaphores      = waitSemaphores;
+	submitInfo.pWaitDstStageMask    = waitStages;
+	submitInfo.commandBufferCount   = 1;
+	submitInfo.pCommandBuffers      = &frameCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores    = signalSemaphores;
+
+	frameStats.beginPhase ( FrameStats::submitPhase );
+
+	vkResetFences ( device.getDevice (), 1, &currentFence );
+
+	if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
+		fatal () << "VulkanWindow: failed to submit frame command buffer!" << Log::endl;
+
+	frameCommandBuffer = VK_NULL_HANDLE;
 }
 
 std::vector<const char*> VulkanWindow::getRequiredExtensions () const
 {
 	uint32_t      glfwExtensionCount = 0;
-	const char ** glfwExtensions     = glfwGetRequiredInstanceExtensions ( &glfwExtensionCount );
+	const char ** glfwExtensions     = nullptr;
+
+			// headless - no surface extensions
+	if ( !headless )
+		glfwExtensions = glfwGetRequiredInstanceExtensions ( &glfwExtensionCount );
 		
 	std::vector<const char*> extensions ( glfwExtensions, glfwExtensions + glfwExtensionCount );
 
@@ -401,19 +788,16 @@ bool	VulkanWindow::checkValidationLayerSupport () const
 
 void	VulkanWindow :: updateFps ()
 {
-	for ( int i = 0; i < 5-1; i++ )
-		frameTime [i] = frameTime [i+1];
-		
-	frameTime [5-1] = (float)getTime ();
-	
-	fps = 5 / (frameTime [5-1] - frameTime [0] + 0.00001f);		// add EPS to avoid zero division
+	float	frameMs = frameStats.getRecentMean ( 30 );
+
+	fps = 1000 / (frameMs + 0.00001f);		// add EPS to avoid zero division
 	frame++;
 	
 	if ( showFps && (frame % 5 == 0) )			// update FPS every 5'th frame
 	{
 		char buf [64];
 		
-		sprintf ( buf, "%5.1f ", fps );
+		sprintf ( buf, "%5.1f (p99 %.1f ms) ", fps, frameStats.percentile ( 0.99 ) );
 		
 		setCaption ( std::string( buf ) + title );
 	}
@@ -421,7 +805,7 @@ void	VulkanWindow :: updateFps ()
 
 void	VulkanWindow::setFullscreen ( bool flag )
 {
-	if ( flag == fullScreen )
+	if ( flag == fullScreen || window == nullptr )
         return;
 
     if ( flag )
@@ -446,11 +830,244 @@ void	VulkanWindow::setFullscreen ( bool flag )
 	fullScreen = flag;
 }
 
-bool	VulkanWindow::makeScreenshot ( const std::string& fileName ) const
+bool	VulkanWindow::hasDeviceExtension ( const char * name ) const
 {
+	uint32_t	count = 0;
+
+	vkEnumerateDeviceExtensionProperties ( device.getPhysicalDevice (), nullptr, &count, nullptr );
+
+	std::vector<VkExtensionProperties>	available ( count );
+
+	vkEnumerateDeviceExtensionProperties ( device.getPhysicalDevice (), nullptr, &count, available.data () );
+
+	for ( const auto& ext : available )
+		if ( strcmp ( ext.extensionName, name ) == 0 )
+			return true;
+
 	return false;
 }
 
+bool	VulkanWindow::makeScreenshot ( const std::string& fileName )
+{
+	std::vector<uint8_t>	pixels;
+
+	if ( !readImage ( pixels ) )
+		return false;
+
+	TgaImage	tga ( getWidth (), getHeight () );
+	bool		ok;
+
+	for ( uint32_t y = 0; y < getHeight (); y++ )
+		for ( uint32_t x = 0; x < getWidth (); x++ )
+		{
+			const uint8_t * p = pixels.data () + 4 * (y * getWidth () + x);
+
+			tga.putPixel ( x, y, tga.rgbToInt ( p [2], p [1], p [0] ) );
+		}
+
+	if ( !(ok = tga.writeToFile ( fileName.c_str () )) )
+		log () << "VulkanWindow: cannot write " << fileName << Log::endl;
+
+	return ok;
+}
+
+bool	VulkanWindow::readImage ( std::vector<uint8_t>& pixels )
+{
+			// presented swap chain image belongs to presentation engine and may lack TRANSFER_SRC usage,
+			// offscreen images of headless mode are ours and always have it
+	if ( !headless )
+	{
+		log () << "VulkanWindow: cannot read back presented image, run with --headless" << Log::endl;
+
+		return false;
+	}
+
+	VkImage	srcImage = swapChain.getImages () [currentImage];
+	Image	image;
+
+			// frame must be complete before copying
+	device.waitIdle ( device.getGraphicsQueue () );
+
+	image.create ( device, ImageCreateInfo ( getWidth (), getHeight () ).setFormat ( VK_FORMAT_R8G8B8A8_UNORM ).setTiling ( VK_IMAGE_TILING_LINEAR ).setUsage ( VK_IMAGE_USAGE_TRANSFER_DST_BIT ), 
+				   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+
+	{
+		SingleTimeCommand	cmd ( device );
+		VkImageCopy			region = {};
+
+		region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.layerCount = 1;
+		region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.dstSubresource.layerCount = 1;
+		region.extent.width              = getWidth  ();
+		region.extent.height             = getHeight ();
+		region.extent.depth              = 1;
+
+		image.transitionLayout  ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+		Image::transitionLayout ( cmd, srcImage, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								  VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL );
+
+				// plain copy, texels keep swap chain's B8G8R8A8 order
+		vkCmdCopyImage ( cmd.getHandle (), srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.getHandle (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+
+		image.transitionLayout  ( cmd, image.getFormat (), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL );
+		Image::transitionLayout ( cmd, srcImage, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								  VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_MEMORY_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR );
+	}
+
+	VkImageSubresource	subResource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0 };
+	VkSubresourceLayout	layout;
+
+	vkGetImageSubresourceLayout ( device.getDevice (), image.getHandle (), &subResource, &layout );
+
+	const uint8_t * data    = (const uint8_t *) image.getMemory ().map ( VK_WHOLE_SIZE );
+	size_t			rowSize = 4 * getWidth ();
+
+	if ( data == nullptr )
+		return false;
+
+	pixels.resize ( rowSize * getHeight () );
+
+			// rows of linear image may be padded
+	for ( uint32_t y = 0; y < getHeight (); y++ )
+		memcpy ( pixels.data () + y * rowSize, data + layout.offset + y * layout.rowPitch, rowSize );
+
+	image.getMemory ().unmap ();
+
+	return true;
+}
+
+void	VulkanWindow::writeBenchmarkReport ( const std::string& fileName, uint32_t frames )
+{
+	FILE * fp = fopen ( fileName.c_str (), "w" );
+
+	if ( fp == nullptr )
+	{
+		log () << "VulkanWindow: cannot write " << fileName << Log::endl;
+
+		return;
+	}
+
+	const VkPhysicalDeviceProperties&	props = device.getProperties ();
+
+	fprintf ( fp, "{\n\"title\": \"%s\",\n\"device\": \"%s\",\n", title.c_str (), props.deviceName );
+	fprintf ( fp, "\"width\": %u,\n\"height\": %u,\n\"frames\": %u,\n\"fps\": %d,\n", getWidth (), getHeight (), frames, (int) RunOptions::benchmarkFps );
+	fprintf ( fp, "\"present_mode\": \"%s\",\n", headless ? "headless" : SwapChain::presentModeName ( getPresentMode () ) );
+	fprintf ( fp, "\"camera_path\": %s,\n", benchmarkController != nullptr ? "true" : "false" );		// false - fixed view, not comparable with scripted runs
+	fprintf ( fp, "\"frame_stats\": " );
+
+	frameStats.writeJson ( fp );				// includes GPU timings added by profilers
+
+	if ( device.getAllocator () != nullptr )
+	{
+		MemoryStats	mem = device.getAllocator ()->getStats ();
+
+		fprintf ( fp, ",\n\"memory\": {\"blocks\": %u, \"allocations\": %u, \"dedicated\": %u, \"block_bytes\": %llu, \"dedicated_bytes\": %llu, "
+					  "\"used_bytes\": %llu, \"wasted_bytes\": %llu, \"free_bytes\": %llu, \"fragmentation\": %.4f}",
+				  mem.blockCount, mem.allocationCount, mem.dedicatedCount, (unsigned long long) mem.blockBytes, (unsigned long long) mem.dedicatedBytes,
+				  (unsigned long long) mem.usedBytes, (unsigned long long) mem.wastedBytes, (unsigned long long) mem.freeBytes, mem.fragmentation () );
+	}
+
+	if ( device.getPipelineCache () != nullptr )
+	{
+		PipelineCacheStats	pc = device.getPipelineCache ()->getStats ();
+
+		fprintf ( fp, ",\n\"pipelines\": {\"created\": %u, \"total_ms\": %.3f, \"max_ms\": %.3f, \"cache_loaded_bytes\": %llu",
+				  pc.created, pc.totalMs, pc.maxMs, (unsigned long long) pc.loadedBytes );
+
+		if ( pc.feedback )
+			fprintf ( fp, ", \"cache_hits\": %u", pc.hits );
+
+		fprintf ( fp, "}" );
+	}
+
+	if ( device.getShaderCache () != nullptr )
+	{
+		ShaderCacheStats	sc = device.getShaderCache ()->getStats ();
+
+		fprintf ( fp, ",\n\"shaders\": {\"requests\": %u, \"hits\": %u, \"files_read\": %u, \"read_ms\": %.3f, \"modules_created\": %u, \"create_ms\": %.3f}",
+				  sc.requests, sc.hits, sc.reads, sc.readMs, sc.created, sc.createMs );
+	}
+
+	if ( device.getDescriptorSetCache () != nullptr )
+	{
+		DescriptorSetCacheStats	ds = device.getDescriptorSetCache ()->getStats ();
+
+		fprintf ( fp, ",\n\"descriptor_sets\": {\"requests\": %u, \"hits\": %u, \"live\": %u, \"dropped\": %u}",
+				  ds.requests, ds.hits, ds.live, ds.dropped );
+	}
+
+	std::vector<uint8_t>	pixels;
+
+			// presented images cannot be read back, so windowed runs have no checksum
+	if ( runOptions ().checksum && !headless )
+		log () << "VulkanWindow: benchmark checksum skipped, it needs --headless" << Log::endl;
+	else
+	if ( runOptions ().checksum && readImage ( pixels ) )
+	{
+		uint64_t	hash = 14695981039346656037ull;		// FNV-1a of final frame
+
+		for ( uint8_t b : pixels )
+			hash = (hash ^ b) * 1099511628211ull;
+
+		fprintf ( fp, ",\n\"checksum\": \"%016llx\"", (unsigned long long) hash );
+	}
+
+	fprintf ( fp, "\n}\n" );
+	fclose  ( fp );
+
+	log () << "VulkanWindow: benchmark report written to " << fileName << Log::endl;
+}
+
+void	VulkanWindow::parseCommandLine ( int argc, const char * argv [] )
+{
+	RunOptions&	options = runOptions ();
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		std::string	arg ( argv [i] );
+
+		if ( arg == "--headless" )
+			options.headless = true;
+		else
+		if ( arg == "--frames" && i + 1 < argc )
+			options.frames = (uint32_t) atoi ( argv [++i] );
+		else
+		if ( arg == "--benchmark" && i + 1 < argc )
+			options.benchmark = argv [++i];
+		else
+		if ( arg == "--no-checksum" )
+			options.checksum = false;
+		else
+		if ( arg == "--pipeline-cache" && i + 1 < argc )
+			options.pipelineCache = argv [++i];
+		else
+		if ( arg == "--no-pipeline-cache" )
+			options.pipelineCache.clear ();
+		else
+		if ( arg == "--bindless" )
+			options.bindless = true;
+		else
+		if ( arg == "--stats" && i + 1 < argc )
+			options.stats = argv [++i];
+		else
+		if ( arg == "--dump" && i + 1 < argc )
+		{
+			options.dumpEvery = (uint32_t) atoi ( argv [++i] );
+
+			if ( i + 1 < argc && argv [i+1][0] != '-' )
+				options.dumpPrefix = argv [++i];
+		}
+	}
+
+	if ( options.dumpEvery > 0 && !options.headless )
+	{
+		log () << "VulkanWindow: --dump requires --headless, ignored" << Log::endl;
+
+		options.dumpEvery = 0;
+	}
+}
+
  VkResult VulkanWindow::createDebugUtilsMessengerEXT ( VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger )
 {
 	auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
@@ -12,15 +12,41 @@
 #include <vector>
 #include <cstdint>
 #include <array>
+#include <chrono>
 
 #include	"Log.h"
 #include	"SwapChain.h"
 #include	"Pipeline.h"
 #include	"Texture.h"
 #include	"Device.h"
+#include	"FrameStats.h"
+#include	"CommandPool.h"
+#include	"DescriptorAllocator.h"
 
 class Buffer;
 class Image;
+class Controller;
+
+		// how to run, set before window is created (e.g. by VulkanWindow::parseCommandLine)
+struct	RunOptions
+{
+	bool		headless   = false;			// render into offscreen images, no window, surface or present
+	uint32_t	frames     = 0;				// stop after this number of frames, 0 - till window is closed
+	uint32_t	dumpEvery  = 0;				// write every N-th frame as image, 0 - never
+	std::string	dumpPrefix = "frame-";		// dumps are written to dumpPrefix<frame>.tga
+	std::string	benchmark;					// if set, run benchmark and write report to benchmark.json
+	bool		checksum   = true;			// add checksum of the final frame to benchmark report
+	std::string	pipelineCache = "pipeline-cache.bin";	// loaded on start and saved on exit, empty - not kept
+	bool		bindless   = false;			// enable descriptor indexing when device supports it
+	std::string	stats;						// if set, frame stats are written to stats.csv and stats.json on exit
+
+	enum
+	{
+		defaultHeadlessFrames  = 100,		// used for headless runs when frames is 0
+		defaultBenchmarkFrames = 600,		// used for benchmark runs when frames is 0
+		benchmarkFps           = 60			// fixed time step of benchmark runs
+	};
+};
 
 class	VulkanWindow
 {
@@ -34,9 +60,17 @@ protected:
 	uint32_t			currentImage = 0;
 	bool				showFps      = false;
 	bool				fullScreen   = false;
+	bool				resizeInPlace = false;	// pipelines do not depend on size, resize without waiting for frames
+	bool				dynamicRecording = false;	// record command buffer every frame with recordFrame
+	bool				headless     = runOptions ().headless;
+	bool				benchmark    = !runOptions ().benchmark.empty ();
+	uint32_t			benchmarkFrame = 0;		// frames drawn in benchmark run, gives its time
+	Controller		  * benchmarkController = nullptr;	// follows scripted path in benchmark run
+	std::chrono::steady_clock::time_point	startTime = std::chrono::steady_clock::now ();	// clock for headless runs
 	int					frame        = 0;		// current frame nulber
-	float				frameTime [5];			// time at last 5 frames for FPS calculations
-	float				fps;
+	float				fps          = 0;
+	FrameStats			frameStats;				// frame times with per-phase breakdown
+	std::string			statsExportName = runOptions ().stats;		// if set, stats are written to name.csv and name.json on exit
 	int					savePosX, savePosY;		// save pos & size when going fullscreen
 	int					saveWidth, saveHeight;	
 
@@ -46,6 +80,9 @@ protected:
 	VkSurfaceKHR					surface         = VK_NULL_HANDLE;
 	SwapChain						swapChain;
 	Texture							depthTexture;
+	std::array<TransientCommandPool, SwapChain::maxFramesInFlight>	framePools;		// reset every frame
+	std::array<DescriptorAllocator,  SwapChain::maxFramesInFlight>	frameDescriptors;	// transient sets, reset every frame
+	VkCommandBuffer					frameCommandBuffer = VK_NULL_HANDLE;		// recorded for current frame
 
 public:
 	VulkanWindow ( int w, int h, const std::string& t, bool depth ) : hasDepth ( depth )
@@ -62,7 +99,9 @@ public:
 	void	setCaption ( const std::string& t )
 	{
 		title = t;
-		glfwSetWindowTitle ( window, title.c_str () );
+
+		if ( window != nullptr )
+			glfwSetWindowTitle ( window, title.c_str () );
 	}
 	
 	std::string	getCaption () const
@@ -72,6 +111,12 @@ public:
 	
 	double	getTime () const	// return time in seconds 
 	{
+		if ( benchmark )		// fixed time step, so every run renders the same frames
+			return benchmarkFrame / double ( RunOptions::benchmarkFps );
+
+		if ( headless )
+			return std::chrono::duration<double> ( std::chrono::steady_clock::now () - startTime ).count ();
+
 		return glfwGetTime ();
 	}
 
@@ -92,7 +137,11 @@ public:
 	
 	void	setSize ( uint32_t w, uint32_t h )
 	{
-		glfwSetWindowSize ( window, width = w, height = h );
+		width  = w;
+		height = h;
+
+		if ( window != nullptr )
+			glfwSetWindowSize ( window, w, h );
 	}
 	
 	float	getAspect () const
@@ -104,10 +153,89 @@ public:
 	{
 		showFps = flag;
 	}
+
+			// record commands of every frame just in time with recordFrame instead of
+			// pre-recording them in createPipelines
+	void	setDynamicRecording ( bool flag )
+	{
+		dynamicRecording = flag;
+	}
+
+			// pool of current frame, for extra (e.g. secondary) buffers recorded this frame
+	TransientCommandPool&	getFrameCommandPool ()
+	{
+		return framePools [swapChain.getCurrentFrame ()];
+	}
+
+			// descriptor sets valid for current frame only, no need to free them
+	DescriptorAllocator&	getFrameDescriptorAllocator ()
+	{
+		return frameDescriptors [swapChain.getCurrentFrame ()];
+	}
+
+			// swap chain settings, applied at once by recreating swap chain or its sync objects
+	void	setPresentMode         ( VkPresentModeKHR mode );
+	void	setFramesInFlight      ( uint32_t count );
+	void	setSwapChainImageCount ( uint32_t count );
+
+			// present mode actually obtained, may differ from requested one
+	VkPresentModeKHR	getPresentMode () const
+	{
+		return swapChain.getPresentMode ();
+	}
+
+	uint32_t	getFramesInFlight () const
+	{
+		return swapChain.getFramesInFlight ();
+	}
 	
 	void	setFullscreen ( bool flag );
+
+	FrameStats&	getFrameStats ()
+	{
+		return frameStats;
+	}
+
+			// write frame stats to baseName.csv (window of frames) and baseName.json (summary) on exit
+	void	setStatsExport ( const std::string& baseName )
+	{
+		statsExportName = baseName;
+	}
 	
-	bool	makeScreenshot ( const std::string& fileName ) const;
+	bool	isHeadless () const
+	{
+		return headless;
+	}
+
+	bool	isBenchmark () const
+	{
+		return benchmark;
+	}
+
+			// controller moved along its scripted path in benchmark runs (see Controller::followPath)
+	void	setBenchmarkController ( Controller * controller )
+	{
+		benchmarkController = controller;
+	}
+
+			// options used by windows created after this call
+	static RunOptions&	runOptions ()
+	{
+		static RunOptions	options;
+
+		return options;
+	}
+
+			// --headless, --frames N, --dump N [prefix], --benchmark name, --no-checksum,
+			// --pipeline-cache file, --no-pipeline-cache, --stats prefix, --bindless,
+			// other arguments are left to the sample
+	static void	parseCommandLine ( int argc, const char * argv [] );
+
+			// write current swap chain image as TGA, image must be in PRESENT_SRC layout, headless mode only
+	bool	makeScreenshot ( const std::string& fileName );
+
+			// read current swap chain image as tightly packed BGRA rows, headless mode only
+	bool	readImage ( std::vector<uint8_t>& pixels );
 
 	virtual	int	run ()
 	{
@@ -122,16 +250,14 @@ public:
 	
 	virtual void mainLoop   ();
 
-			// cleanup swap chain objects due to window resize
+			// cleanup swap chain objects due to window resize, old swap chain itself
+			// is kept for handoff and retired when new one is created
 	void cleanupSwapChain ()
 	{
-		depthTexture.clean ();
+		depthTexture.deferredClean ();
 		
 				// clean up objects in upper classes
 		freePipelines ();
-
-				// swapChain.cleanup without destroying sync objects
-		swapChain.cleanup ( false );
 	}
 
 			// recreate swap chain objects due to window resize
@@ -141,6 +267,9 @@ public:
 	{
 		QueueFamilyIndices indices = Device::findQueueFamilies ( device, surface );
 
+		if ( headless )
+			return indices.graphicsFamily != QueueFamilyIndices::noValue;
+
 		return indices.isComplete ();
 	}
 
@@ -150,18 +279,24 @@ public:
 	void	createLogicalDevice ();
 	void	createCommandPool   ();
 	void	createDepthTexture  ();
+	void	createSwapChain     ( int w, int h );		// real one or headless image ring
 	
 	void	createSurface ()
 	{
+		if ( headless )
+			return;
+
 		if ( glfwCreateWindowSurface ( device.getInstance (), window, nullptr, &surface ) != VK_SUCCESS )
 			fatal () << "VulkanWindow: failed to create window surface!";
 	}
 
 	void	destroyCommandPool ()
 	{
-		vkDestroyCommandPool ( device.getDevice (), device.getCommandPool (), nullptr );
+		vkDestroyCommandPool ( device.getDevice (), device.getCommandPool (),         nullptr );
+		vkDestroyCommandPool ( device.getDevice (), device.getTransferCommandPool (), nullptr );
 		
-		device.commandPool = VK_NULL_HANDLE;
+		device.commandPool         = VK_NULL_HANDLE;
+		device.transferCommandPool = VK_NULL_HANDLE;
 	}
 
 				// create pipelines, renderpasses, command buffers and descriptor sets
@@ -170,9 +305,17 @@ public:
 	
 				// free them when close or change window size
 	virtual	void	freePipelines   () {}
+
+				// rebuild only objects depending on swap chain images and size (framebuffers, command buffers
+				// referencing them) when resizeInPlace is set, old ones should go to the deletion queue
+	virtual	void	recreateFramebuffers () {}
 	
 	virtual	void	drawFrame ();
-	virtual	void	submit    ( uint32_t imageIndex ) {}			// perform actual sumitting of rendering 
+	virtual	void	submit    ( uint32_t imageIndex );			// perform actual sumitting of rendering 
+
+				// record commands for swap chain image into cmd (already begun) when dynamic
+				// recording is on, cmd comes from pool of current frame and is submitted by submit
+	virtual	void	recordFrame ( VkCommandBuffer cmd, uint32_t imageIndex ) {}
 	
 				// window events
 	virtual	void	reshape     ( int w, int h ) {}
@@ -184,6 +327,8 @@ public:
 	
 private:
 	void	updateFps ();
+	bool	hasDeviceExtension ( const char * name ) const;
+	void	writeBenchmarkReport ( const std::string& fileName, uint32_t frames );
 	
 	std::vector<const char*> getRequiredExtensions () const;
 	bool checkValidationLayerSupport () const;
@@ -32,6 +32,9 @@ glslangValidator.exe -V  pbr.frag -o pbr.frag.spv
 glslangValidator.exe -V  pbr-2.vert -o pbr-2.vert.spv 
 glslangValidator.exe -V  pbr-2.frag -o pbr-2.frag.spv 
 
+glslangValidator.exe -V  pbr-2-bindless.vert -o pbr-2-bindless.vert.spv 
+glslangValidator.exe -V  pbr-2-bindless.frag -o pbr-2-bindless.frag.spv 
+
 glslangValidator.exe -V ds-3-1.vert -o ds-3-1.vert.spv
 glslangValidator.exe -V ds-3-1.frag -o ds-3-1.frag.spv
 glslangValidator.exe -V ds-3-2.vert -o ds-3-2.vert.spv
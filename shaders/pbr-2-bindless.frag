@@ -0,0 +1,98 @@
+//
+// pbr-2.frag with all textures in one bindless array,
+// material of mesh gives indices of its textures
+//
+
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+struct Material
+{
+	uint albedo;
+	uint metallness;
+	uint normal;
+	uint roughness;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Materials
+{
+	Material materials [];
+};
+
+layout(set = 1, binding = 1) uniform sampler2D textures [];
+
+layout(location = 0) in  vec2 tx;
+layout(location = 1) in  vec3 v;
+layout(location = 2) in  vec3 l;
+layout(location = 3) in  vec3 h;
+layout(location = 4) flat in uint mesh;
+layout(location = 0) out vec4 color;
+
+const vec3      lightColor = vec3 ( 1.0 );
+
+const float gamma = 2.2;
+const float pi    = 3.1415926;
+const float FDiel = 0.04;		// Fresnel for dielectrics
+
+vec3 fresnel ( in vec3 f0, in float product )
+{
+    return mix ( f0, vec3 (1.0), pow(1.0 - product, 5.0) );
+}
+
+float D_GGX ( in float roughness, in float NdH )
+{
+    float m  = roughness * roughness;
+    float m2 = m * m;
+	float ndh2 = NdH * NdH;
+	float d  = ndh2 * (m2 - 1.0) + 1.0;
+	
+    return m2 / (pi * d * d);
+}
+
+float G_schlick ( in float roughness, in float nv, in float nl )
+{
+roughness = (roughness+1)*(roughness+1)/8;
+
+    float k = roughness * roughness * 0.5;
+    float V = nv * (1.0 - k) + k;
+    float L = nl * (1.0 - k) + k;
+	
+	return nv * nl / ( V * L );
+}
+
+vec3 cookTorrance ( in float nl, in float nv, in float nh, in vec3 f0, in float roughness )
+{
+    float D = D_GGX     ( roughness, nh );
+    float G = G_schlick ( roughness, nv, nl );
+
+	return f0 * D * G;
+}
+
+void main ()
+{
+	Material mat     = materials [mesh];		// same for the whole draw
+	vec3 base        = texture ( textures [mat.albedo],     tx ).xyz;
+	vec3 n           = texture ( textures [mat.normal],     tx ).xyz * 2.0 - vec3 ( 1.0 );
+	float roughness  = texture ( textures [mat.roughness],  tx ).x;
+	float metallness = texture ( textures [mat.metallness], tx ).x;
+
+n= vec3 ( 0, 0, 1 );
+
+	base = pow ( base, vec3 ( gamma ) );
+	
+	vec3  n2   = normalize ( n );
+	vec3  l2   = normalize ( l );
+	vec3  h2   = normalize ( h );
+	vec3  v2   = normalize ( v ); 
+	float nv   = max ( 0.0, dot ( n2, v2 ));
+	float nl   = max ( 0.0, dot ( n2, l2 ));
+	float nh   = max ( 0.0, dot ( n2, h2 ));
+
+	vec3 F0          = mix ( vec3(FDiel), base, metallness );
+	vec3 specfresnel = fresnel ( F0, nv );
+	vec3 spec        = cookTorrance ( nl, nv, nh, specfresnel, roughness ) / ( 0.001 + 4.0 * nl * nv );
+	vec3 diff        = (vec3(1.0) - specfresnel)  / pi;
+	
+	color = pow ( vec4 ( ( diff * mix ( base, vec3(0.0), metallness) + spec ) * lightColor, 1.0 ), vec4 ( 1.0 / gamma ) );
+}
@@ -170,9 +170,11 @@ public:
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores    = signalSemaphores1;
 
+		frameStats.beginPhase ( FrameStats::submitPhase );
+
 		vkResetFences ( device.getDevice (), 1, &currentFence );
 
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
 
 				
@@ -180,7 +182,7 @@ public:
 		submitInfo.pSignalSemaphores  = signalSemaphores2;	// Signal ready with render complete semaphpre
 		submitInfo.pCommandBuffers    = &commandBuffers [imageIndex];
 		
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
 	}
 
@@ -392,6 +394,8 @@ public:
 
 int main ( int argc, const char * argv [] ) 
 {
+	VulkanWindow::parseCommandLine ( argc, argv );
+
 	TestWindow	win ( 800, 600, "Test window" );
 
 	return win.run ();
@@ -159,9 +159,11 @@ public:
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores    = signalSemaphores;
 
+		frameStats.beginPhase ( FrameStats::submitPhase );
+
 		vkResetFences ( device.getDevice (), 1, &currentFence );
 
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
 	}
 
@@ -244,6 +246,8 @@ public:
 
 int main ( int argc, const char * argv [] ) 
 {
+	VulkanWindow::parseCommandLine ( argc, argv );
+
 	TestWindow	win ( 1000, 900, "Test window" );
 
 	return win.run ();
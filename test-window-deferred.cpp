@@ -8,11 +8,14 @@
 #include	"Texture.h"
 #include	"stb_image_aug.h"
 #include	"BasicMesh.h"
+#include	"GeometryHeap.h"
 #include	"TgaImage.h"
 #include	"Framebuffer.h"
 #include	"Semaphore.h"
 #include	"ScreenQuad.h"
 #include	"CameraController.h"
+#include	"GpuProfiler.h"
+#include	"PipelineBatch.h"
 
 struct UniformBufferObject 
 {
@@ -28,12 +31,11 @@ class	DeferredWindow : public VulkanWindow
 	GraphicsPipeline				pipeline;
 	Renderpass						renderPass;
 	std::vector<Buffer>				uniformBuffers;
-	DescriptorPool					descriptorPool;
 	std::vector<DescriptorSet> 		descriptorSets;
 	Image							image;
 	Sampler							sampler;
 	Framebuffer						fb;					// G-buffer 
-	VkCommandBuffer					offscreenCmd = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer>	offscreenCmds;		// G-buffer pass, one per swap chain image
 	DescriptorSet					offscreenDescriptorSet;
 	Semaphore						offscreenSemaphore;
 	GraphicsPipeline				offscreenPipeline;
@@ -43,6 +45,7 @@ class	DeferredWindow : public VulkanWindow
 	double							time = 0;
 
 	DescriptorSet					offscreenDescriptorSet1, offscreenDescriptorSet2, offscreenDescriptorSet3;
+	GeometryHeap					geometry;			// all meshes share one vertex/index buffer pair
 
 	BasicMesh * box1 = nullptr;		// decalMap, bump1 -> DS1
 	BasicMesh * box2 = nullptr;		// stoneMap. bump2 -> DS2
@@ -54,10 +57,15 @@ class	DeferredWindow : public VulkanWindow
 	Texture							decalMap, stoneMap, knotMap;
 	Texture							bump1, bump2;
 	CameraController				controller;
+	GpuProfiler						profiler;			// slot per swap chain image
+	uint32_t						gbufferScope  = 0;
+	uint32_t						lightingScope = 0;
 
 public:
 	DeferredWindow ( int w, int h, const std::string& t ) : VulkanWindow ( w, h, t, true ), controller ( this )
 	{
+		setBenchmarkController ( &controller );
+
 		sampler.create ( device );		// use default optiona		
 		screen.create  ( device );
 
@@ -74,13 +82,23 @@ public:
 		  .addAttachment ( VK_FORMAT_D24_UNORM_S8_UINT,  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT  )
 		  .create ();
 		  
-			// create meshes
+			// create meshes, all of them go into one geometry heap
+		geometry.create ( device, sizeof ( BasicVertex ), 64*1024, 256*1024 );
+		device.setGeometryHeap ( &geometry );
+
 		box1 = createBox  ( device, glm::vec3 ( -6, -0.1, -6 ),   glm::vec3 ( 12, 3, 12 ), nullptr, true );
 		box2 = createBox  ( device, glm::vec3 ( -1.5, 0, -0.5 ),  glm::vec3 ( 1,  2,  2 ) );
 		box3 = createBox  ( device, glm::vec3 ( 1.5, 0, -0.5 ),   glm::vec3 ( 1,  1,  1 ) );
 		box4 = createBox  ( device, glm::vec3 ( -4, 0, -0.5 ),    glm::vec3 ( 1,  1,  1 ) );
 		box5 = createBox  ( device, glm::vec3 ( -4, 0, -4 ),      glm::vec3 ( 1,  1,  1 ) ); 
 		knot = createKnot ( device, 1, 4, 120, 30 );
+
+		device.setGeometryHeap ( nullptr );
+
+			// draw () relies on heap buffers being bound, a mesh that fell back to its own buffers would read wrong geometry
+		for ( auto mesh : { box1, box2, box3, box4, box5, knot } )
+			if ( !mesh->isInHeap () )
+				fatal () << "geometry heap is too small for mesh " << mesh->getName () << Log::endl;
 				
 			// create all pipelines
 		createPipelines ();
@@ -94,6 +112,8 @@ public:
 		delete box4;
 		delete box5;
 		delete knot;
+
+		geometry.clean ();
 	}
 
 	void	createUniformBuffers ()
@@ -112,6 +132,7 @@ public:
 			uniformBuffers [i].clean ();
 	}
 
+			// sets come from device cache, so identical bindings are written once
 	void	createDescriptorSets ()
 	{
 		descriptorSets.resize ( swapChain.imageCount () );
@@ -120,7 +141,7 @@ public:
 		for ( uint32_t i = 0; i < swapChain.imageCount (); i++ )
 		{
 			descriptorSets  [i]
-				.setLayout ( device, pipeline.getDescLayout (), descriptorPool )
+				.setLayout ( device, pipeline.getDescLayout () )
 				.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [i], 0, sizeof ( UniformBufferObject ) )
 				.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, fb.getAttachment ( 0 ), sampler )
 				.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, fb.getAttachment ( 1 ), sampler )
@@ -129,7 +150,7 @@ public:
 		
 			// create descriptors for rendering boxes 
 		offscreenDescriptorSet1
-			.setLayout ( device, offscreenPipeline.getDescLayout (), descriptorPool )
+			.setLayout ( device, offscreenPipeline.getDescLayout () )
 			.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [0], 0, sizeof ( UniformBufferObject ) )
 			.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, decalMap, sampler )
 			.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bump1,    sampler )
@@ -137,7 +158,7 @@ public:
 
 		
 		offscreenDescriptorSet2
-			.setLayout ( device, offscreenPipeline.getDescLayout (), descriptorPool )
+			.setLayout ( device, offscreenPipeline.getDescLayout () )
 			.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [0], 0, sizeof ( UniformBufferObject ) )
 			.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stoneMap, sampler )
 			.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bump2,    sampler )
@@ -145,7 +166,7 @@ public:
 
 		
 		offscreenDescriptorSet3
-			.setLayout ( device, offscreenPipeline.getDescLayout (), descriptorPool )
+			.setLayout ( device, offscreenPipeline.getDescLayout () )
 			.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [0], 0, sizeof ( UniformBufferObject ) )
 			.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, knotMap, sampler )
 			.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bump2,   sampler )
@@ -158,12 +179,6 @@ public:
 	{
 		createUniformBuffers ();
 
-		descriptorPool
-			.setMaxSets            ( 15+swapChain.imageCount () )
-			.setUniformBufferCount ( 15+swapChain.imageCount () )
-			.setImageCount         ( 15+swapChain.imageCount () )
-			.create                ( device );
-
 			// current app code
 		renderPass.addAttachment   ( swapChain.getFormat (),                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR )
 				  .addAttachment   ( depthTexture.getImage ().getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL )
@@ -184,8 +199,7 @@ public:
 				.setCullMode       ( VK_CULL_MODE_NONE )
 				.setFrontFace      ( VK_FRONT_FACE_COUNTER_CLOCKWISE )
 				.setDepthTest      ( true )
-				.setDepthWrite     ( true )
-				.create            ( renderPass );
+				.setDepthWrite     ( true );
 			
 		box1->setVertexAttrs ( offscreenPipeline )
 				.setDevice         ( device )
@@ -200,14 +214,19 @@ public:
 				.setCullMode       ( VK_CULL_MODE_NONE )
 				.setFrontFace      ( VK_FRONT_FACE_COUNTER_CLOCKWISE )
 				.setDepthTest      ( true )
-				.setDepthWrite     ( true )
-				.create            ( fb.getRenderpass () );
-			
+				.setDepthWrite     ( true );
+
+			// both pipelines are compiled concurrently
+		PipelineBatch ()
+			.add    ( pipeline,          renderPass          )
+			.add    ( offscreenPipeline, fb.getRenderpass () )
+			.create ();
 
 
 				// create before command buffers
 		swapChain.createFramebuffers ( renderPass.getHandle (), depthTexture.getImageView () );
 
+		createProfiler               ();
 		createDescriptorSets         ();
 		createCommandBuffers         ( renderPass.getHandle (), pipeline.getHandle () );
 		createOffscreenCommandBuffer ();
@@ -217,12 +236,15 @@ public:
 	{
 		vkFreeCommandBuffers ( device.getDevice (), device.getCommandPool (), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data () );
 
+		vkFreeCommandBuffers ( device.getDevice (), device.getCommandPool (), static_cast<uint32_t>(offscreenCmds.size()), offscreenCmds.data () );
+
 		commandBuffers.clear ();	
+		offscreenCmds.clear  ();
+		profiler.clean       ();
 		pipeline.clean       ();
 		renderPass.clean     ();
 		freeUniformBuffers   ();
 		descriptorSets.clear ();
-		descriptorPool.clean ();
 	}
 	
 	virtual	void	submit ( uint32_t imageIndex ) override 
@@ -241,13 +263,18 @@ public:
 		submitInfo.pWaitSemaphores      = waitSemaphores;
 		submitInfo.pWaitDstStageMask    = waitStages;
 		submitInfo.commandBufferCount   = 1;
-		submitInfo.pCommandBuffers      = &offscreenCmd;	//&commandBuffers [imageIndex];
+		submitInfo.pCommandBuffers      = &offscreenCmds [imageIndex];
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores    = signalSemaphores1;
 
+		frameStats.beginPhase ( FrameStats::submitPhase );
+
+				// timings of frames whose commands have completed by now
+		profiler.collect ( &frameStats );
+
 		vkResetFences ( device.getDevice (), 1, &currentFence );
 
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
 
 				
@@ -255,8 +282,19 @@ public:
 		submitInfo.pSignalSemaphores  = signalSemaphores2;	// Signal ready with render complete semaphpre
 		submitInfo.pCommandBuffers    = &commandBuffers [imageIndex];
 		
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS )
+				// fence covers both passes, so command buffers and queries of this image are reused safely
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
+
+		profiler.submitted ( imageIndex );
+	}
+
+	void	createProfiler ()
+	{
+		profiler.create ( device, swapChain.imageCount (), 4, device.getGraphicsFamilyIndex () );
+
+		gbufferScope  = profiler.scope ( "gbuffer"  );
+		lightingScope = profiler.scope ( "lighting" );
 	}
 
 	void	createCommandBuffers ( VkRenderPass renderPass, VkPipeline pipeline )			// size - swapChain.framebuffers.size ()
@@ -296,6 +334,8 @@ public:
 			renderPassInfo.clearValueCount   = 2;
 			renderPassInfo.pClearValues      = clearValues;
 
+			profiler.begin ( commandBuffers [i], (uint32_t) i, lightingScope );
+
 			vkCmdBeginRenderPass  ( commandBuffers [i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
 
 			vkCmdBindPipeline ( commandBuffers [i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline );
@@ -309,6 +349,8 @@ public:
 
 			vkCmdEndRenderPass     ( commandBuffers [i] );
 
+			profiler.end ( commandBuffers [i], (uint32_t) i, lightingScope );
+
 			if ( vkEndCommandBuffer ( commandBuffers [i] ) != VK_SUCCESS )
 				fatal () << "VulkanWindow: failed to record command buffer!";
 		}
@@ -317,26 +359,35 @@ public:
 	void	createOffscreenCommandBuffer ()
 	{
 		offscreenSemaphore.create ( device );
+		offscreenCmds.resize      ( swapChain.imageCount () );
 		
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.commandPool        = device.getCommandPool ();
 		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = 1;
+		allocInfo.commandBufferCount = (uint32_t) offscreenCmds.size ();
 
-		if ( vkAllocateCommandBuffers ( device.getDevice (), &allocInfo, &offscreenCmd ) != VK_SUCCESS )
+		if ( vkAllocateCommandBuffers ( device.getDevice (), &allocInfo, offscreenCmds.data () ) != VK_SUCCESS )
 			fatal () << "VulkanWindow: failed to allocate offscreen command buffer!";
 		
+			// one command buffer per image, so its queries are not reset while previous frame still uses them
+		for ( uint32_t i = 0; i < offscreenCmds.size (); i++ )
+			recordOffscreenCommandBuffer ( offscreenCmds [i], i );
+	}
+
+	void	recordOffscreenCommandBuffer ( VkCommandBuffer offscreenCmd, uint32_t slot )
+	{
 		VkCommandBufferBeginInfo beginInfo = {};
 		
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-// XXX
-beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-// XXX
 
 		if ( vkBeginCommandBuffer ( offscreenCmd, &beginInfo ) != VK_SUCCESS )
 			fatal () << "VulkanWindow: failed to begin recording command buffer!";
 
+			// queries of this slot are reset here, lighting pass is submitted after this buffer
+		profiler.reset ( offscreenCmd, slot );
+		profiler.begin ( offscreenCmd, slot, gbufferScope );
+
 		VkRenderPassBeginInfo	renderPassInfo = {};
 		VkClearValue			clearValues [3] = {};
 
@@ -355,31 +406,34 @@ beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 		vkCmdBeginRenderPass ( offscreenCmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
 		vkCmdBindPipeline    ( offscreenCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline.getHandle () );
 
-		VkDeviceSize	offsets [] = { 0 };
 		VkDescriptorSet	descSet1    = offscreenDescriptorSet1.getHandle ();
 		VkDescriptorSet	descSet2    = offscreenDescriptorSet2.getHandle ();
 		VkDescriptorSet	descSet3    = offscreenDescriptorSet3.getHandle ();
 
+				// bind shared vertex/index buffers once, meshes only issue draws
+		geometry.bind ( offscreenCmd );
+
 		vkCmdBindDescriptorSets ( offscreenCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline.getLayout (), 0, 1, &descSet1, 0, nullptr );
 
-		box1->render  ( offscreenCmd );
+		box1->draw  ( offscreenCmd );
 
 		vkCmdBindDescriptorSets ( offscreenCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline.getLayout (), 0, 1, &descSet2, 0, nullptr );
 
-		box2->render  ( offscreenCmd );
-		box3->render  ( offscreenCmd );
-		box4->render  ( offscreenCmd );
-		box5->render  ( offscreenCmd );
+		box2->draw  ( offscreenCmd );
+		box3->draw  ( offscreenCmd );
+		box4->draw  ( offscreenCmd );
+		box5->draw  ( offscreenCmd );
 
 		vkCmdBindDescriptorSets ( offscreenCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline.getLayout (), 0, 1, &descSet3, 0, nullptr );
 
-		knot->render  ( offscreenCmd );
+		knot->draw  ( offscreenCmd );
 
 		vkCmdEndRenderPass     ( offscreenCmd );
 
+		profiler.end ( offscreenCmd, slot, gbufferScope );
+
 		if ( vkEndCommandBuffer ( offscreenCmd ) != VK_SUCCESS )
 			fatal () << "VulkanWindow: failed to record command buffer!";
-		
 	}
 	
 	void updateUniformBuffer ( uint32_t currentImage )
@@ -479,6 +533,8 @@ beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
 int main ( int argc, const char * argv [] ) 
 {
+	VulkanWindow::parseCommandLine ( argc, argv );
+
 	DeferredWindow	win ( 1200, 900, "Deferred rendering in Vulkan" );
 
 	return win.run ();
@@ -5,11 +5,15 @@
 #include	"VulkanWindow.h"
 #include	"Buffer.h"
 #include	"DescriptorSet.h"
+#include	"UniformRing.h"
 #include	"Texture.h"
 #include	"stb_image_aug.h"
 #include	"BasicMesh.h"
 #include	"TgaImage.h"
 #include	"Controller.h"
+#include	"Trace.h"
+#include	"ParallelRecorder.h"
+#include	"BindlessTextures.h"
 
 struct alignas(16) UniformBufferObject 
 //struct UniformBufferObject 
@@ -22,6 +26,14 @@ struct alignas(16) UniformBufferObject
 	glm::mat4 nm;		// use mat3(ubo.nm)
 };
 
+struct	GpuMaterial					// texture indices of material, std430
+{
+	uint32_t	albedo;
+	uint32_t	metallic;
+	uint32_t	normal;
+	uint32_t	roughness;
+};
+
 void	loadDds ( Device& device, Texture& texture, Data& data );
 
 class	PbrWindow : public VulkanWindow
@@ -29,13 +41,17 @@ class	PbrWindow : public VulkanWindow
 	std::vector<VkCommandBuffer>	commandBuffers;
 	GraphicsPipeline				pipeline;
 	Renderpass						renderPass;
-	std::vector<Buffer>				uniformBuffers;
-	DescriptorPool					descriptorPool;
-	std::vector<DescriptorSet>		descriptorSets;
+	UniformRing						uniformRing;
+	DescriptorAllocator				descriptors;		// grows with number of materials
+	DescriptorSet					descriptorSet;
 	Texture							albedo, metallic, normal, roughness;
 	Sampler							sampler;
 	MultiMesh						mesh2;
 	RotateController				controller;
+	ParallelRecorder				recorder;			// submeshes are recorded by worker threads
+	bool							bindless = false;	// all textures in one array, run with --bindless
+	BindlessTextures				bindlessTextures;
+	Buffer							materialBuffer;		// GpuMaterial for every submesh
 	
 	struct	PbrMaterial
 	{
@@ -56,10 +72,10 @@ class	PbrWindow : public VulkanWindow
 	
 				// use set 0 as UBO
 				// and set 1 as textures/PBR data
-		void	createDescriptorSet ( Device& device, GraphicsPipeline& pipeline, DescriptorPool& descriptorPool, Sampler& sampler )
+		void	createDescriptorSet ( Device& device, GraphicsPipeline& pipeline, DescriptorAllocator& descriptors, Sampler& sampler )
 		{
 			descriptorSet
-					.setLayout ( device, pipeline.getDescLayout ( 1 ), descriptorPool )
+					.setLayout ( device, pipeline.getDescLayout ( 1 ), descriptors )
 //					.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [i], 0, sizeof ( UniformBufferObject ) )
 					.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, albedo,     sampler )
 					.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, metallic,   sampler )
@@ -74,6 +90,8 @@ class	PbrWindow : public VulkanWindow
 public:
 	PbrWindow ( int w, int h, const std::string& t ) : VulkanWindow ( w, h, t, true ), controller ( this )
 	{
+		setBenchmarkController ( &controller );
+
 		loadAllMeshes ( "models/FBX/beretta-92/source/BR_test_lp_v3.fbx", mesh2, 0.15f );
 
 		mesh2  .create ( device );
@@ -91,7 +109,11 @@ public:
 			materials.push_back ( mat );
 		}
 		
-		createPipelines ();
+		bindless = device.hasDescriptorIndexing ();
+
+		recorder.create    ( device );
+		descriptors.create ( device );
+		createPipelines    ();
 	}
 
 	~PbrWindow ()
@@ -102,46 +124,58 @@ public:
 
 	void	createUniformBuffers ()
 	{
-		VkDeviceSize bufferSize = sizeof ( UniformBufferObject );
-
-		uniformBuffers.resize ( swapChain.imageCount() );
-		
-		for ( size_t i = 0; i < swapChain.imageCount (); i++ )
-			uniformBuffers [i].create ( device, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+		uniformRing.create ( device, swapChain.imageCount (), sizeof ( UniformBufferObject ) );
 	}
 
 	void	freeUniformBuffers ()
 	{
-		for ( size_t i = 0; i < swapChain.imageCount (); i++ )
-			uniformBuffers [i].clean ();
+		uniformRing.clean ();
 	}
 
+			// set 0 is shared by all images, per-image uniforms are selected by dynamic offset
 	void	createDescriptorSets ()
 	{
-		descriptorSets.resize ( swapChain.imageCount () );
+		descriptorSet
+			.setLayout ( device, pipeline.getDescLayout (), descriptors )
+			.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.getBuffer (), 0, sizeof ( UniformBufferObject ) )
+			.create    ();
+
+		if ( bindless )
+			createBindlessSet ();
+		else
+			for ( auto m : materials )
+				m->createDescriptorSet ( device, pipeline, descriptors, sampler );
+	}
 
-		for ( uint32_t i = 0; i < swapChain.imageCount (); i++ )
-		{
-			descriptorSets  [i]
-				.setLayout ( device, pipeline.getDescLayout (), descriptorPool )
-				.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [i], 0, sizeof ( UniformBufferObject ) )
-				.create    ();
-		}
+			// set 1 holds textures of all materials and buffer of their indices
+	void	createBindlessSet ()
+	{
+		std::vector<GpuMaterial>	gpuMaterials;
+
+		bindlessTextures.create ( device, pipeline.getDescLayout ( 1 ), 1, maxTextures () );
 
 		for ( auto m : materials )
-			m->createDescriptorSet ( device, pipeline, descriptorPool, sampler );
+			gpuMaterials.push_back ( { bindlessTextures.add ( m->albedo,    sampler ), bindlessTextures.add ( m->metallic,  sampler ),
+									   bindlessTextures.add ( m->normal,    sampler ), bindlessTextures.add ( m->roughness, sampler ) } );
+
+		VkDeviceSize	size = std::max ( (size_t) 1, gpuMaterials.size () ) * sizeof ( GpuMaterial );
+
+		materialBuffer.create ( device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+		materialBuffer.copy   ( gpuMaterials.data (), gpuMaterials.size () * sizeof ( GpuMaterial ) );
+		bindlessTextures.addBuffer ( 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, materialBuffer );
+	}
+
+	uint32_t	maxTextures () const
+	{
+		return std::max ( 1u, 4 * (uint32_t) materials.size () );
 	}
 	
 	virtual	void	createPipelines () override 
 	{
+		TraceScope	trace ( "PbrWindow::createPipelines" );
+
 		createUniformBuffers ();
 
-		descriptorPool
-			.setMaxSets            ( 5*swapChain.imageCount () )
-			.setUniformBufferCount ( 5*swapChain.imageCount   () )
-			.setImageCount         ( 35*swapChain.imageCount () )
-			.create                ( device );
-		
 			// current app code
 		renderPass.addAttachment   ( swapChain.getFormat (),                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR )
 				  .addAttachment   ( depthTexture.getImage ().getFormat (), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL )
@@ -149,10 +183,23 @@ public:
 				  .addDepthSubpass ( 1 )
 		          .create          ( device );
 		
+		DescSetLayout	materialLayout;			// set 1
+
+		if ( bindless )
+			materialLayout
+				.add         ( 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         VK_SHADER_STAGE_FRAGMENT_BIT )
+				.addBindless ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, maxTextures () );
+		else
+			materialLayout
+				.add ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
+				.add ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
+				.add ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
+				.add ( 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT );
+
 		mesh2.setVertexAttrs ( pipeline )
 				.setDevice ( device )
-				.setVertexShader   ( "shaders/pbr-2.vert.spv" )
-				.setFragmentShader ( "shaders/pbr-2.frag.spv" )
+				.setVertexShader   ( bindless ? "shaders/pbr-2-bindless.vert.spv" : "shaders/pbr-2.vert.spv" )
+				.setFragmentShader ( bindless ? "shaders/pbr-2-bindless.frag.spv" : "shaders/pbr-2.frag.spv" )
 				.setSize           ( swapChain.getExtent ().width, swapChain.getExtent ().height )
 				.addVertexBinding  ( sizeof ( BasicVertex ), 0, VK_VERTEX_INPUT_RATE_VERTEX )
 //				.addDescriptor     ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         VK_SHADER_STAGE_VERTEX_BIT )
@@ -160,12 +207,8 @@ public:
 //				.addDescriptor     ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
 //				.addDescriptor     ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
 //				.addDescriptor     ( 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
-				.addDescLayout     ( 0, DescSetLayout ().add ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT ) )
-				.addDescLayout     ( 1, DescSetLayout ()
-							.add ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
-							.add ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
-							.add ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
-							.add ( 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT ) )
+				.addDescLayout     ( 0, DescSetLayout ().add ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT ) )
+				.addDescLayout     ( 1, materialLayout )
 				.setCullMode       ( VK_CULL_MODE_NONE               )
 				.setFrontFace      ( VK_FRONT_FACE_COUNTER_CLOCKWISE )
 				.setDepthTest      ( true )
@@ -188,8 +231,10 @@ public:
 		pipeline.clean       ();
 		renderPass.clean     ();
 		freeUniformBuffers   ();
-		descriptorSets.clear ();
-		descriptorPool.clean ();
+		descriptorSet.clean  ();
+		descriptors.reset    ();		// pools are kept for sets of new pipeline
+		bindlessTextures.clean ();
+		materialBuffer.clean   ();
 		
 		for ( auto m : materials )
 			m->descriptorSet.clean ();
@@ -215,9 +260,11 @@ public:
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores    = signalSemaphores;
 
+		frameStats.beginPhase ( FrameStats::submitPhase );
+
 		vkResetFences ( device.getDevice (), 1, &currentFence );
 
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
 	}
 
@@ -258,20 +305,38 @@ public:
 			renderPassInfo.clearValueCount   = 2;
 			renderPassInfo.pClearValues      = clearValues;
 
-			vkCmdBeginRenderPass  ( commandBuffers [i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
-			vkCmdBindPipeline     ( commandBuffers [i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline );
+			uint32_t	dynamicOffset = uniformRing.frameOffset ( i );
 
-			//VkDeviceSize	offsets [] = { 0 };
-			
-			for ( size_t j = 0; j < materials.size (); j++ )
-			{
-				VkDescriptorSet	descSet [] = { descriptorSets [i].getHandle (), materials [j]->descriptorSet.getHandle () };
+					// every thread records its range of submeshes into a secondary buffer
+			recorder.record ( (uint32_t) i, renderPass, 0, framebuffers [i], (uint32_t) materials.size (), 
+				[&] ( VkCommandBuffer cmd, uint32_t first, uint32_t last )
+				{
+					vkCmdBindPipeline ( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline );
 
-				vkCmdBindDescriptorSets ( commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline.getLayout (), 0, 2, descSet, 0, nullptr );
+							// sets are bound once for the whole range, material is picked by mesh index
+					if ( bindless )
+					{
+						VkDescriptorSet	descSet [] = { descriptorSet.getHandle (), bindlessTextures.getHandle () };
 
-				mesh2.render ( commandBuffers [i], (uint32_t) j );
-			}
-			
+						vkCmdBindDescriptorSets ( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline.getLayout (), 0, 2, descSet, 1, &dynamicOffset );
+
+						mesh2.renderRange ( cmd, first, last );
+
+						return;
+					}
+
+					for ( uint32_t j = first; j < last; j++ )
+					{
+						VkDescriptorSet	descSet [] = { descriptorSet.getHandle (), materials [j]->descriptorSet.getHandle () };
+
+						vkCmdBindDescriptorSets ( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline.getLayout (), 0, 2, descSet, 1, &dynamicOffset );
+
+						mesh2.render ( cmd, j );
+					}
+				} );
+
+			vkCmdBeginRenderPass   ( commandBuffers [i], &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+			recorder.execute       ( commandBuffers [i], (uint32_t) i );
 			vkCmdEndRenderPass     ( commandBuffers [i] );
 
 			if ( vkEndCommandBuffer ( commandBuffers [i] ) != VK_SUCCESS )
@@ -350,7 +415,9 @@ public:
 		ubo.eye      = glm::vec4 ( controller.getEye (), 1.0f );					//glm::vec4 ( 4.0f );
 		ubo.lightDir = glm::vec4 ( 0.0f, 0.0f, 1.0f, 1.0f );
 
-		uniformBuffers [currentImage].copy ( &ubo, sizeof ( ubo ) );
+		uniformRing.beginFrame ( currentImage );
+		uniformRing.push       ( ubo );
+		uniformRing.flush      ();
 	}
 	
 	virtual	void	mouseMotion ( double x, double y ) 
@@ -380,7 +447,26 @@ public:
 
 int main ( int argc, const char * argv [] ) 
 {
+	std::string	traceFile;
+
+			// --trace file.json records startup and frames, open it in chrome://tracing or ui.perfetto.dev
+	for ( int i = 1; i + 1 < argc; i++ )
+		if ( std::string ( argv [i] ) == "--trace" )
+			traceFile = argv [i+1];
+
+	VulkanWindow::parseCommandLine ( argc, argv );
+
+	if ( !traceFile.empty () )
+	{
+		Trace::setThreadName ( "main" );
+		Trace::start         ();
+	}
+
 	PbrWindow	win ( 1200, 900, "PBR" );
+	int			res = win.run ();
+
+	if ( !traceFile.empty () )
+		Trace::exportChrome ( traceFile );
 
-	return win.run ();
+	return res;
 }
@@ -7,6 +7,7 @@
 #include	"TgaImage.h"
 #include	"Semaphore.h"
 #include	"CommandPool.h"
+#include	"GpuProfiler.h"
 
 struct UniformBufferObject 		// for render pipeline
 {
@@ -15,21 +16,42 @@ struct UniformBufferObject 		// for render pipeline
 	glm::mat4 proj;
 };
 
+struct	SimulationParams			// push constants of compute pipeline
+{
+	float		deltaT;
+	uint32_t	count;				// number of particles
+};
+
+		// Simulation step N reads state N%2 and writes the other one, while rendering
+		// of frame N draws state N%2 produced by step N-1. So step N runs on compute queue
+		// at the same time as frame N is rendered, semaphores do all the handoffs:
+		//	step N   waits for rendering of frame N-1 (it read the state step N overwrites)
+		//	frame N  waits for step N-1 (it produced the state frame N draws)
 class	TestWindow : public VulkanWindow
 {
-	std::vector<VkCommandBuffer>	commandBuffers;
+	std::vector<VkCommandBuffer>	commandBuffers [2];		// per swap chain image, drawing state 0 or 1
 	GraphicsPipeline				graphicsPipeline;
 	ComputePipeline					computePipeline;
 	Renderpass						renderPass;
 	std::vector<Buffer>				uniformBuffers;
 	DescriptorPool					descriptorPool;
 	std::vector<DescriptorSet> 		descriptorSets;
-	Buffer							posBuffer;
-	Buffer							velBuffer;
-	DescriptorSet					computeDescriptorSet;
-	VkCommandBuffer					computeCommandBuffer = VK_NULL_HANDLE;
-	Semaphore						computeSemaphore, graphicsSemaphore;
+	Buffer							posBuffer [2];			// double-buffered particle state
+	Buffer							velBuffer [2];
+	DescriptorSet					computeDescriptorSet [2];	// step reading state i, writing state 1-i
+	VkCommandBuffer					computeCommandBuffer [2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	Semaphore						computeDone [2];		// indexed by step parity
+	Semaphore						renderDone  [2];
 	CommandPool						computeCommandPool;
+	Fence							computeFence;			// only for serialized mode
+	GpuProfiler						profiler;				// compute queue, slot per step parity
+	uint32_t						simulateScope = 0;
+	uint64_t						step    = 0;			// simulation steps (and frames) submitted
+	bool							overlap = true;			// false - serialize CPU, compute and graphics as before
+	int								measureFrames = 0;		// frames left in current measurement phase
+	int								measurePhase  = 0;		// 1 - serialized, 2 - overlapped
+	double							measureStart  = 0;
+	double							serialFrameTime = 0;
 	size_t							n;
 	size_t							numParticles;
 	float							t     = 0;				// current time in seconds
@@ -37,15 +59,23 @@ class	TestWindow : public VulkanWindow
 	float							zFar  = 100.0f;	
 //	glm::vec3						eye   = glm::vec3 ( 4.0f, 4.0f, 4.0f );
 	glm::vec3						eye   = glm::vec3 ( -0.5, 0.5, 15 );
-	std::vector<Fence>				fences;
+
+	enum
+	{
+		measureLength = 300			// frames in each measurement phase
+	};
 
 public:
 	TestWindow ( int w, int h, const std::string& t ) : VulkanWindow ( w, h, t, true )
 	{
 		computeCommandPool.create ( device, false, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT );
-		graphicsSemaphore.create  ( device );
-		computeSemaphore.create   ( device );
-		computeSemaphore.signal   ( device.getGraphicsQueue () );
+		computeFence.create       ( device );
+
+		for ( int i = 0; i < 2; i++ )
+		{
+			computeDone [i].create ( device );
+			renderDone  [i].create ( device );
+		}
 		
 		initParticles   ( 64 );
 		createPipelines ();
@@ -53,30 +83,64 @@ public:
 
 	~TestWindow () {}
 
-	virtual	void	drawFrame () override
+				// submit simulation step, it reads state step%2 and writes the other one
+	void	submitCompute ( VkFence fence )
 	{
-		VulkanWindow::drawFrame ();
-
-		VkSubmitInfo			submitInfo                 = {};
-		VkPipelineStageFlags	computeWaitStages          = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-		VkSemaphore				computeWaitSemaphores   [] = { graphicsSemaphore.getHandle () };
-		VkSemaphore				computeSignalSemaphores [] = { computeSemaphore.getHandle  () };
+		uint32_t				src             = step % 2;
+		VkSubmitInfo			submitInfo      = {};
+		VkPipelineStageFlags	waitStage       = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		VkSemaphore				waitSemaphore   = renderDone  [1 - src].getHandle ();		// rendering of previous frame
+		VkSemaphore				signalSemaphore = computeDone [src].getHandle ();
 
 		submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.waitSemaphoreCount   = 1;
-		submitInfo.pWaitSemaphores      = computeWaitSemaphores;
-		submitInfo.pWaitDstStageMask    = &computeWaitStages;
+		submitInfo.waitSemaphoreCount   = step > 0 ? 1 : 0;
+		submitInfo.pWaitSemaphores      = &waitSemaphore;
+		submitInfo.pWaitDstStageMask    = &waitStage;
 		submitInfo.commandBufferCount   = 1;
-		submitInfo.pCommandBuffers      = &computeCommandBuffer;
+		submitInfo.pCommandBuffers      = &computeCommandBuffer [src];
 		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores    = computeSignalSemaphores;
+		submitInfo.pSignalSemaphores    = &signalSemaphore;
 
-		if ( vkQueueSubmit ( device.getComputeQueue (), 1, &submitInfo, fences [currentImage].getHandle () ) != VK_SUCCESS )
-			fatal () << "failed to submit draw command buffer!";
+				// step that used this slot two steps ago is usually done by now
+		profiler.collect ( &frameStats );
+
+		if ( device.submit ( device.getComputeQueue (), 1, &submitInfo, fence ) != VK_SUCCESS )
+			fatal () << "failed to submit compute command buffer!" << Log::endl;
+
+		profiler.submitted ( src );
+	}
+
+	virtual	void	idle () override
+	{
+		if ( measurePhase == 0 || --measureFrames > 0 )
+			return;
 
-		fences [currentImage].wait  ( UINT64_MAX );
-		fences [currentImage].reset ();
+		double	frameTime = (getTime () - measureStart) / measureLength;
 
+		if ( measurePhase == 1 )
+		{
+			serialFrameTime = frameTime;
+			measurePhase    = 2;
+			measureFrames   = measureLength;
+			measureStart    = getTime ();
+			overlap         = true;
+
+			return;
+		}
+
+		log () << "Particles: serialized " << serialFrameTime * 1000 << " ms/frame, overlapped " << frameTime * 1000 
+		       << " ms/frame, gain " << 100 * (serialFrameTime - frameTime) / serialFrameTime << "%" << Log::endl;
+
+		measurePhase = 0;
+	}
+
+				// run some frames serialized, then the same number overlapped and report both
+	void	startMeasure ()
+	{
+		measurePhase  = 1;
+		measureFrames = measureLength;
+		measureStart  = getTime ();
+		overlap       = false;
 	}
 
 	void	createDescriptorSets ()
@@ -91,12 +155,14 @@ public:
 				.create    ();
 		}
 		
-		computeDescriptorSet
-			.setLayout ( device, computePipeline.getDescLayout (), descriptorPool )
-			.addBuffer ( 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, posBuffer )
-			.addBuffer ( 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, velBuffer )
-			.create    ();
-
+		for ( int i = 0; i < 2; i++ )
+			computeDescriptorSet [i]
+				.setLayout ( device, computePipeline.getDescLayout (), descriptorPool )
+				.addBuffer ( 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, posBuffer [i]   )
+				.addBuffer ( 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, velBuffer [i]   )
+				.addBuffer ( 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, posBuffer [1-i] )
+				.addBuffer ( 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, velBuffer [1-i] )
+				.create    ();
 	}
 	
 	virtual	void	createPipelines () override 
@@ -110,10 +176,10 @@ public:
 
 
 		descriptorPool
-			.setMaxSets            ( 3+swapChain.imageCount () )
+			.setMaxSets            ( 4+swapChain.imageCount () )
 			.setUniformBufferCount ( 3+swapChain.imageCount () )
 			.setImageCount         ( 3+swapChain.imageCount () )
-			.setStorageBufferCount ( 2 )
+			.setStorageBufferCount ( 8 )
 			.create                ( device );		
 		
 			// current app code
@@ -141,35 +207,51 @@ public:
 				.create            ( renderPass );
 			
 		computePipeline
-			.setDevice     ( device )
-			.setShader     ( "shaders/particles.comp.spv" )
-			.addDescriptor ( 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT )
-			.addDescriptor ( 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT )
-			.create        ();
+			.setDevice            ( device )
+			.setShader            ( "shaders/particles.comp.spv" )
+			.addDescriptor        ( 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT )
+			.addDescriptor        ( 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT )
+			.addDescriptor        ( 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT )
+			.addDescriptor        ( 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT )
+			.addPushConstantRange ( VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof ( SimulationParams ) )
+			.create               ();
 		
 				// create before command buffers
 		swapChain.createFramebuffers ( renderPass.getHandle (), depthTexture.getImageView () );
 
-		createDescriptorSets       ();
-		createCommandBuffers       ( renderPass.getHandle (), graphicsPipeline.getHandle () );
-		createComputeCommandBuffer ();
-		
-		fences.resize ( swapChain.imageCount () );
+		createDescriptorSets ();
+
+		profiler.create ( device, 2, 1, device.getComputeFamilyIndex () );
 
-		for ( auto& f : fences )
-			f.create ( device );
+		simulateScope = profiler.scope ( "simulate" );
+
+		for ( int i = 0; i < 2; i++ )
+		{
+			createCommandBuffers        ( commandBuffers [i], renderPass.getHandle (), graphicsPipeline.getHandle (), posBuffer [i] );
+			createComputeCommandBuffer  ( i );
+		}
 	}
 
 	virtual	void	freePipelines () override
 	{
-		vkFreeCommandBuffers ( device.getDevice (), device.getCommandPool (), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data () );
+				// last simulation step is waited for only by next frame, so wait for it here
+		device.waitIdle ( device.getComputeQueue () );
+
+		for ( int i = 0; i < 2; i++ )
+		{
+			vkFreeCommandBuffers ( device.getDevice (), device.getCommandPool (), static_cast<uint32_t>(commandBuffers [i].size()), commandBuffers [i].data () );
+			vkFreeCommandBuffers ( device.getDevice (), computeCommandPool.getHandle (), 1, &computeCommandBuffer [i] );
+
+			commandBuffers       [i].clear ();
+			computeDescriptorSet [i].clean ();
+		}
 
 		for ( size_t i = 0; i < swapChain.imageCount (); i++ )
 			uniformBuffers [i].clean ();
 
-		commandBuffers.clear   ();
 		graphicsPipeline.clean ();
 		computePipeline.clean  ();
+		profiler.clean         ();
 		renderPass.clean       ();
 		descriptorSets.clear   ();
 		descriptorPool.clean   ();
@@ -179,28 +261,46 @@ public:
 	{
 		updateUniformBuffer ( imageIndex );
 
+		uint32_t	src = step % 2;					// state drawn by this frame and read by this step
+
+		frameStats.beginPhase ( FrameStats::submitPhase );
+
+				// serialized reference mode: nothing of previous frame may still run
+		if ( !overlap )
+			device.waitIdle ( device.getGraphicsQueue () );
+
+		submitCompute ( overlap ? VK_NULL_HANDLE : computeFence.getHandle () );
+
+		if ( !overlap )
+		{
+			computeFence.wait  ( UINT64_MAX );
+			computeFence.reset ();
+		}
+
 		VkSubmitInfo			submitInfo                  = {};
-		VkSemaphore				waitSemaphores           [] = { swapChain.currentAvailableSemaphore (), computeSemaphore.getHandle () };
-		VkPipelineStageFlags	graphicsWaitStages       [] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		VkSemaphore				graphicsSignalSemaphores [] = { swapChain.currentRenderFinishedSemaphore (), graphicsSemaphore.getHandle () };
+		VkSemaphore				waitSemaphores           [] = { swapChain.currentAvailableSemaphore (), computeDone [1 - src].getHandle () };
+		VkPipelineStageFlags	graphicsWaitStages       [] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+		VkSemaphore				graphicsSignalSemaphores [] = { swapChain.currentRenderFinishedSemaphore (), renderDone [src].getHandle () };
 		VkFence					currentFence                = swapChain.currentInFlightFence ();
 
 		submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.waitSemaphoreCount   = 2;
+		submitInfo.waitSemaphoreCount   = step > 0 ? 2 : 1;		// first frame draws initial state
 		submitInfo.pWaitSemaphores      = waitSemaphores;
 		submitInfo.pWaitDstStageMask    = graphicsWaitStages;
 		submitInfo.commandBufferCount   = 1;
-		submitInfo.pCommandBuffers      = &commandBuffers [imageIndex];
+		submitInfo.pCommandBuffers      = &commandBuffers [src][imageIndex];
 		submitInfo.signalSemaphoreCount = 2;
 		submitInfo.pSignalSemaphores    = graphicsSignalSemaphores;
 
 		vkResetFences ( device.getDevice (), 1, &currentFence );
 
-		if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
+		if ( device.submit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
 			fatal () << "failed to submit draw command buffer!";
+
+		step++;
 	}
 
-	void	createCommandBuffers ( VkRenderPass renderPass, VkPipeline pipeline )
+	void	createCommandBuffers ( std::vector<VkCommandBuffer>& commandBuffers, VkRenderPass renderPass, VkPipeline pipeline, Buffer& posBuffer )
 	{
 		auto	framebuffers = swapChain.getFramebuffers ();
 
@@ -255,69 +355,38 @@ public:
 		}
 	}
 
-	void	createComputeCommandBuffer ()
+				// step reading state index and writing the other one, buffers are shared concurrently
+				// by graphics and compute families and semaphores order all accesses, so no barriers here
+	void	createComputeCommandBuffer ( int index )
 	{
-		computeCommandBuffer = computeCommandPool.alloc ();
+		computeCommandBuffer [index] = computeCommandPool.alloc ();
 		
 		VkCommandBufferBeginInfo beginInfo = {};
 
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-		if ( vkBeginCommandBuffer ( computeCommandBuffer, &beginInfo ) != VK_SUCCESS )
+		if ( vkBeginCommandBuffer ( computeCommandBuffer [index], &beginInfo ) != VK_SUCCESS )
 			fatal () << "Cannot begin compute command buffer" << Log::endl;
 
-			// Add memory barrier to ensure that the (graphics) vertex shader has fetched 
-			// attributes before compute starts to write to the buffer
-		if ( device.getGraphicsQueue () != device.getComputeQueue () )
-		{
-			transitionBuffer ( posBuffer, 0, VK_ACCESS_SHADER_WRITE_BIT, device.getGraphicsFamilyIndex (), device.getComputeFamilyIndex (), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
-			transitionBuffer ( velBuffer, 0, VK_ACCESS_SHADER_WRITE_BIT, device.getGraphicsFamilyIndex (), device.getComputeFamilyIndex (), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
-		}
-
 			// Dispatch the compute job
-		VkDescriptorSet	descSet = computeDescriptorSet.getHandle ();
+		VkDescriptorSet		descSet = computeDescriptorSet [index].getHandle ();
+		SimulationParams	params  = { 0.00003f, (uint32_t) numParticles };
 
-		vkCmdBindPipeline       ( computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline.getHandle () );
-		vkCmdBindDescriptorSets ( computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline.getLayout (), 0, 1, &descSet, 0, nullptr );
-		vkCmdDispatch           ( computeCommandBuffer, (uint32_t) (numParticles + 1023) / 1024, 1, 1 );
+		profiler.reset ( computeCommandBuffer [index], index );
+		profiler.begin ( computeCommandBuffer [index], index, simulateScope );
 
-			// Add barrier to ensure that compute shader has finished writing to the buffer
-			// Without this the (rendering) vertex shader may display incomplete results (partial data from last frame) 
-		if ( device.getGraphicsQueue () != device.getComputeQueue () )
-		{
-			transitionBuffer ( posBuffer, VK_ACCESS_SHADER_WRITE_BIT, 0, device.getComputeFamilyIndex (), device.getGraphicsFamilyIndex (), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
-			transitionBuffer ( velBuffer, VK_ACCESS_SHADER_WRITE_BIT, 0, device.getComputeFamilyIndex (), device.getGraphicsFamilyIndex (), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
-		}
+		vkCmdBindPipeline       ( computeCommandBuffer [index], VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline.getHandle () );
+		vkCmdBindDescriptorSets ( computeCommandBuffer [index], VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline.getLayout (), 0, 1, &descSet, 0, nullptr );
 
-		vkEndCommandBuffer ( computeCommandBuffer );
-	}
+				// step parameters travel with the dispatch, no buffer to write
+		computePipeline.pushConstants ( computeCommandBuffer [index], VK_SHADER_STAGE_COMPUTE_BIT, params );
 
-				// transition buffer from one queue family to another
-	void	transitionBuffer ( Buffer& buf, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, uint32_t srcFamily, uint32_t dstFamily, 
-							   VkPipelineStageFlags srcStageFlags, VkPipelineStageFlags dstStageFlags )
-	{
-		VkBufferMemoryBarrier bufferBarrier =
-		{
-			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-			nullptr,
-			srcAccessMask,
-			dstAccessMask,
-			srcFamily,
-			dstFamily,
-			posBuffer.getHandle (),
-			0,
-			VK_WHOLE_SIZE
-		};
-
-		vkCmdPipelineBarrier (
-			computeCommandBuffer,
-			srcStageFlags,
-			dstStageFlags,
-			0,
-			0, nullptr,
-			1, &bufferBarrier,
-			0, nullptr );
+		vkCmdDispatch           ( computeCommandBuffer [index], (uint32_t) (numParticles + 1023) / 1024, 1, 1 );
+
+		profiler.end ( computeCommandBuffer [index], index, simulateScope );
+
+		vkEndCommandBuffer      ( computeCommandBuffer [index] );
 	}
 	
 	void updateUniformBuffer ( uint32_t currentImage )
@@ -389,10 +458,10 @@ public:
 		Buffer				stagingBuffer;
 		SingleTimeCommand	cmd ( device );
 
-			// use staging buffer to copy data to GPU-local memory
+			// use staging buffer to copy data to GPU-local memory, buffer is used by both graphics and compute queues
 		stagingBuffer.create ( device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
 		stagingBuffer.copy   ( data, size );
-		buffer.create        ( device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		buffer.create        ( device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, { device.getGraphicsFamilyIndex (), device.getComputeFamilyIndex () } );
 		buffer.copyBuffer    ( cmd, stagingBuffer, size );
 
 	}
@@ -417,8 +486,11 @@ public:
 					vb.push_back ( glm::vec4 ( 0 ) );
 				}
 
-		createBuffer ( posBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,  numParticles * sizeof ( pb [0] ), pb.data () );
-		createBuffer ( velBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,  numParticles * sizeof ( vb [0] ), vb.data () );
+		for ( int i = 0; i < 2; i++ )
+		{
+			createBuffer ( posBuffer [i], VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,  numParticles * sizeof ( pb [0] ), pb.data () );
+			createBuffer ( velBuffer [i], VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,  numParticles * sizeof ( vb [0] ), vb.data () );
+		}
 	}
 
 	virtual	void	keyTyped ( int key, int scancode, int action, int mods ) override
@@ -428,12 +500,23 @@ public:
 
 		if ( key == GLFW_KEY_F1 && action == GLFW_PRESS )
 			saveScreenshot ();
+
+		if ( key == GLFW_KEY_F2 && action == GLFW_PRESS && measurePhase == 0 )
+		{
+			overlap = !overlap;
+			log () << "Particles: compute " << (overlap ? "overlapped with rendering" : "serialized") << Log::endl;
+		}
+
+		if ( key == GLFW_KEY_F3 && action == GLFW_PRESS && measurePhase == 0 )
+			startMeasure ();
 	}
 
 };
 
 int main ( int argc, const char * argv [] ) 
 {
+	VulkanWindow::parseCommandLine ( argc, argv );
+
 	TestWindow	win ( 1400, 900, "Compute particles" );
 
 	return win.run ();
@@ -5,6 +5,7 @@
 #include	"VulkanWindow.h"
 #include	"Buffer.h"
 #include	"DescriptorSet.h"
+#include	"UniformRing.h"
 #include	"Texture.h"
 #include	"stb_image_aug.h"
 #include	"BasicMesh.h"
@@ -23,12 +24,11 @@ struct alignas(16) UniformBufferObject
 
 class	PbrWindow : public VulkanWindow
 {
-	std::vector<VkCommandBuffer>	commandBuffers;
 	GraphicsPipeline				pipeline;
 	Renderpass						renderPass;
-	std::vector<Buffer>				uniformBuffers;
+	UniformRing						uniformRing;
 	DescriptorPool					descriptorPool;
-	std::vector<DescriptorSet> 		descriptorSets;
+	DescriptorSet			 		descriptorSet;
 	//Image							image;
 	Texture							albedo, metallic, normal, roughness;
 	Sampler							sampler;
@@ -47,7 +47,10 @@ public:
 		normal.   load2D  ( device, "textures/rusted_iron/normal.png",    true );
 		roughness.load2D  ( device, "textures/rusted_iron/roughness.png", true );
 
-		createPipelines ();
+		setDynamicRecording ( true );		// commands are recorded every frame by recordFrame
+		createPipelines     ();
+
+		resizeInPlace = true;				// viewport is dynamic, only framebuffers depend on size
 	}
 
 	~PbrWindow ()
@@ -57,35 +60,25 @@ public:
 
 	void	createUniformBuffers ()
 	{
-		VkDeviceSize bufferSize = sizeof ( UniformBufferObject );
-
-		uniformBuffers.resize ( swapChain.imageCount() );
-		
-		for ( size_t i = 0; i < swapChain.imageCount (); i++ )
-			uniformBuffers [i].create ( device, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+		uniformRing.create ( device, SwapChain::maxFramesInFlight, sizeof ( UniformBufferObject ) );
 	}
 
 	void	freeUniformBuffers ()
 	{
-		for ( size_t i = 0; i < swapChain.imageCount (); i++ )
-			uniformBuffers [i].clean ();
+		uniformRing.clean ();
 	}
 
+			// single set for all frames, per-frame uniforms are selected by dynamic offset
 	void	createDescriptorSets ()
 	{
-		descriptorSets.resize ( swapChain.imageCount () );
-
-		for ( uint32_t i = 0; i < swapChain.imageCount (); i++ )
-		{
-			descriptorSets  [i]
-				.setLayout ( device, pipeline.getDescLayout (), descriptorPool )
-				.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffers [i], 0, sizeof ( UniformBufferObject ) )
-				.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, albedo,     sampler )
-				.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, metallic,   sampler )
-				.addImage  ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, normal,     sampler )
-				.addImage  ( 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, roughness,  sampler )
-				.create    ();
-		}
+		descriptorSet
+			.setLayout ( device, pipeline.getDescLayout (), descriptorPool )
+			.addBuffer ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.getBuffer (), 0, sizeof ( UniformBufferObject ) )
+			.addImage  ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, albedo,     sampler )
+			.addImage  ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, metallic,   sampler )
+			.addImage  ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, normal,     sampler )
+			.addImage  ( 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, roughness,  sampler )
+			.create    ();
 	}
 	
 	virtual	void	createPipelines () override 
@@ -93,10 +86,10 @@ public:
 		createUniformBuffers ();
 
 		descriptorPool
-			.setMaxSets            ( 5*swapChain.imageCount () )
-			.setUniformBufferCount ( swapChain.imageCount   () )
-			.setImageCount         ( 4*swapChain.imageCount () )
-			.create                ( device );
+			.setMaxSets                   ( 1 )
+			.setDynamicUniformBufferCount ( 1 )
+			.setImageCount                ( 4 )
+			.create                       ( device );
 		
 			// current app code
 		renderPass.addAttachment   ( swapChain.getFormat (),                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR )
@@ -109,7 +102,7 @@ public:
 				.setDevice ( device )
 				.setVertexShader   ( "shaders/pbr.vert.spv" )
 				.setFragmentShader ( "shaders/pbr.frag.spv" )
-				.setSize           ( swapChain.getExtent ().width, swapChain.getExtent ().height )
+				.setDynamicViewport ()
 				.addVertexBinding  ( sizeof ( BasicVertex ), 0, VK_VERTEX_INPUT_RATE_VERTEX )
 //				.addDescriptor     ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         VK_SHADER_STAGE_VERTEX_BIT )
 //				.addDescriptor     ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
@@ -117,7 +110,7 @@ public:
 //				.addDescriptor     ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
 //				.addDescriptor     ( 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
 				.addDescLayout     ( 0, DescSetLayout ()
-							.add ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         VK_SHADER_STAGE_VERTEX_BIT )
+							.add ( 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT )
 							.add ( 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
 							.add ( 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
 							.add ( 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT )
@@ -133,105 +126,62 @@ public:
 		swapChain.createFramebuffers ( renderPass.getHandle (), depthTexture.getImageView () );
 
 		createDescriptorSets ();
+	}
 
-		createCommandBuffers         ( renderPass.getHandle (), pipeline.getHandle () );
+	virtual	void	recreateFramebuffers () override
+	{
+		swapChain.createFramebuffers ( renderPass.getHandle (), depthTexture.getImageView () );
 	}
 
 	virtual	void	freePipelines () override
 	{
-		vkFreeCommandBuffers ( device.getDevice (), device.getCommandPool (), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data () );
-
-		commandBuffers.clear ();
-		
 		pipeline.clean   ();
 		renderPass.clean ();
 		freeUniformBuffers ();
-		descriptorSets.clear ();
+		descriptorSet.clean ();
 
 		descriptorPool.clean ();
 	}
 	
 	virtual	void	submit ( uint32_t imageIndex ) override 
 	{
-		updateUniformBuffer ( imageIndex );
-
-		VkSubmitInfo			submitInfo          = {};
-		VkSemaphore				waitSemaphores   [] = { swapChain.currentAvailableSemaphore () };
-		VkPipelineStageFlags	waitStages       [] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		VkSemaphore				signalSemaphores [] = { swapChain.currentRenderFinishedSemaphore () };
-		VkFence					currentFence        = swapChain.currentInFlightFence ();
-
-        submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.waitSemaphoreCount   = 1;
-        submitInfo.pWaitSemaphores      = waitSemaphores;
-        submitInfo.pWaitDstStageMask    = waitStages;
-        submitInfo.commandBufferCount   = 1;
-        submitInfo.pCommandBuffers      = &commandBuffers [imageIndex];
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores    = signalSemaphores;
-
-        vkResetFences ( device.getDevice (), 1, &currentFence );
-
-        if ( vkQueueSubmit ( device.getGraphicsQueue (), 1, &submitInfo, currentFence ) != VK_SUCCESS )
-            fatal () << "failed to submit draw command buffer!";
+		updateUniformBuffer   ( swapChain.getCurrentFrame () );
+		VulkanWindow::submit  ( imageIndex );
 	}
 
-	void	createCommandBuffers ( VkRenderPass renderPass, VkPipeline pipeline )			// size - swapChain.framebuffers.size ()
+			// command buffer comes from per-frame transient pool, so what is drawn may change every frame
+	virtual	void	recordFrame ( VkCommandBuffer cmd, uint32_t imageIndex ) override
 	{
-		auto	framebuffers = swapChain.getFramebuffers ();
-
-		commandBuffers.resize ( framebuffers.size () );
-
-		VkCommandBufferAllocateInfo allocInfo = {};
-		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool        = device.getCommandPool ();
-		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t) framebuffers.size ();
-
-		if ( vkAllocateCommandBuffers ( device.getDevice (), &allocInfo, commandBuffers.data () ) != VK_SUCCESS )
-			fatal () << "VulkanWindow: failed to allocate command buffers!";
-
-		for ( size_t i = 0; i < commandBuffers.size(); i++ )
-		{
-			VkCommandBufferBeginInfo beginInfo = {};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-			if ( vkBeginCommandBuffer ( commandBuffers[i], &beginInfo ) != VK_SUCCESS )
-				fatal () << "VulkanWindow: failed to begin recording command buffer!";
-
-			VkRenderPassBeginInfo	renderPassInfo  = {};
-			VkClearValue			clearValues [2] = {};
-			
-			clearValues[0].color        = {0.0f, 0.0f, 0.0f, 1.0f};
-			clearValues[1].depthStencil = {1.0f, 0};
-
-			renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass        = renderPass;
-			renderPassInfo.framebuffer       = framebuffers [i];
-			renderPassInfo.renderArea.offset = {0, 0};
-			renderPassInfo.renderArea.extent = swapChain.getExtent ();
-			renderPassInfo.clearValueCount   = 2;
-			renderPassInfo.pClearValues      = clearValues;
+		VkRenderPassBeginInfo	renderPassInfo  = {};
+		VkClearValue			clearValues [2] = {};
+		
+		clearValues[0].color        = {0.0f, 0.0f, 0.0f, 1.0f};
+		clearValues[1].depthStencil = {1.0f, 0};
 
-			vkCmdBeginRenderPass  ( commandBuffers [i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
+		renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass        = renderPass.getHandle ();
+		renderPassInfo.framebuffer       = swapChain.getFramebuffers () [imageIndex];
+		renderPassInfo.renderArea.offset = {0, 0};
+		renderPassInfo.renderArea.extent = swapChain.getExtent ();
+		renderPassInfo.clearValueCount   = 2;
+		renderPassInfo.pClearValues      = clearValues;
 
-			vkCmdBindPipeline ( commandBuffers [i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline );
+		vkCmdBeginRenderPass  ( cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
 
-			VkDeviceSize	offsets       [] = { 0 };
-			VkDescriptorSet	descSet          = descriptorSets[i].getHandle ();
+		vkCmdBindPipeline    ( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getHandle () );
+		pipeline.setViewport ( cmd, getWidth (), getHeight () );
 
-			vkCmdBindDescriptorSets ( commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline.getLayout (), 0, 1, &descSet, 0, nullptr );
+		VkDescriptorSet	descSet          = descriptorSet.getHandle ();
+		uint32_t		dynamicOffset    = uniformRing.frameOffset ( swapChain.getCurrentFrame () );
 
-			mesh->render  ( commandBuffers [i] );
+		vkCmdBindDescriptorSets ( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout (), 0, 1, &descSet, 1, &dynamicOffset );
 
-			vkCmdEndRenderPass     ( commandBuffers [i] );
+		mesh->render  ( cmd );
 
-			if ( vkEndCommandBuffer ( commandBuffers [i] ) != VK_SUCCESS )
-				fatal () << "VulkanWindow: failed to record command buffer!";
-		}
+		vkCmdEndRenderPass ( cmd );
 	}
 
-	void updateUniformBuffer ( uint32_t currentImage )
+	void updateUniformBuffer ( uint32_t frameIndex )
 	{
 		float				time = (float)getTime ();
 		UniformBufferObject ubo  = {};
@@ -254,7 +204,9 @@ public:
 		ubo.eye      = glm::vec4 ( 4.0f );
 		ubo.lightDir = glm::vec4 ( 0.0f, 0.0f, 1.0f, 1.0f );
 
-		uniformBuffers [currentImage].copy ( &ubo, sizeof ( ubo ) );
+		uniformRing.beginFrame ( frameIndex );
+		uniformRing.push       ( ubo );
+		uniformRing.flush      ();
 
 		//log () << "Time = " << time << Log::endl;
 	}
@@ -323,6 +275,8 @@ public:
 
 int main ( int argc, const char * argv [] ) 
 {
+	VulkanWindow::parseCommandLine ( argc, argv );
+
 	PbrWindow	win ( 800, 600, "PBR" );
 
 	return win.run ();